@@ -3,9 +3,59 @@
 #include <iostream>
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstring>
 #include <fstream>
 #include <cstdlib>
-#include <unordered_set>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <vector>
+#include <unordered_map>
+#include <string_view>
+#include <type_traits>
+#include <iomanip>
+#include <ctime>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#define BDL_HAS_TSC 1
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#define BDL_HAS_TSC 1
+#include <intrin.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#define BDL_POSIX 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <csignal>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+// io_uring through the raw system calls, no liburing. BDL_NO_IO_URING forces the pwrite thread
+#if defined(__has_include) && !defined(BDL_NO_IO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_OFF_SQES)
+#define BDL_HAS_IO_URING 1
+#endif
+#endif
+#endif
+#endif
 
 namespace BDL { // Ensure the namespace is defined
 
@@ -14,46 +64,4732 @@ namespace BDL { // Ensure the namespace is defined
 #define BDL_C_FLAG_FILE_OUTPUT 0x02
 #define BDL_C_FLAG_CONSOLE_OUTPUT 0x04
 #define BDL_C_FLAG_LOOP_CHECK 0x10
+#define BDL_C_FLAG_LOCK_FREE 0x20
+#define BDL_C_FLAG_ASYNC_OUTPUT 0x40
+#define BDL_C_FLAG_BINARY_OUTPUT 0x80
+#define BDL_C_FLAG_MAPPED_FILE 0x100
+#define BDL_C_FLAG_TIMESTAMPS 0x200
+#define BDL_C_FLAG_THREAD_BUFFERS 0x400
+#define BDL_C_FLAG_FLIGHT_RECORDER 0x800
+#define BDL_C_FLAG_SHARED_BACKEND 0x1000
+#define BDL_C_FLAG_ASYNC_FILE 0x2000
+#define BDL_C_FLAG_DURABLE_FLUSH 0x4000
 
-class loggerConstructor {
+//Numeric severity levels, statements below BDL_MIN_LEVEL are removed at compile time
+#define BDL_LEVEL_TRACE 0
+#define BDL_LEVEL_DEBUG 1
+#define BDL_LEVEL_INFO 2
+#define BDL_LEVEL_WARN 3
+#define BDL_LEVEL_ERROR 4
+#define BDL_LEVEL_FATAL 5
+#define BDL_LEVEL_OFF 6
+#ifndef BDL_MIN_LEVEL
+#define BDL_MIN_LEVEL BDL_LEVEL_TRACE
+#endif
+
+// Self-metrics (getStats()), compiled out unless built with -DBDL_STATS=1
+#ifndef BDL_STATS
+#define BDL_STATS 0
+#endif
+#define BDL_STATS_BUCKETS 24
+
+enum class severity : unsigned char {
+    trace = BDL_LEVEL_TRACE,
+    debug = BDL_LEVEL_DEBUG,
+    info = BDL_LEVEL_INFO,
+    warn = BDL_LEVEL_WARN,
+    error = BDL_LEVEL_ERROR,
+    fatal = BDL_LEVEL_FATAL,
+    off = BDL_LEVEL_OFF
+};
+inline std::string_view severityName(severity level) {
+    static constexpr std::string_view names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL", "OFF" };
+    return names[static_cast<unsigned char>(level) <= BDL_LEVEL_OFF ? static_cast<unsigned char>(level) : BDL_LEVEL_OFF];
+}
+inline std::string_view severityPrefix(severity level) {
+    static constexpr std::string_view prefixes[] = { "[TRACE]", "[DEBUG]", "[INFO]", "[WARN]", "[ERROR]", "[FATAL]", "[OFF]" };
+    return prefixes[static_cast<unsigned char>(level) <= BDL_LEVEL_OFF ? static_cast<unsigned char>(level) : BDL_LEVEL_OFF];
+}
+constexpr bool severityCompiledIn(severity level) {
+    return static_cast<int>(level) - BDL_MIN_LEVEL >= 0;
+}
+// Maps a setLogLevel() name to its severity, unknown names count as info
+inline severity severityFromName(std::string_view name) {
+    std::string upper(name);
+    for (char& c : upper) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    if (upper == "WARNING") {
+        return severity::warn;
+    }
+    for (unsigned char i = BDL_LEVEL_TRACE; i < BDL_LEVEL_OFF; ++i) {
+        if (upper == severityName(static_cast<severity>(i))) {
+            return static_cast<severity>(i);
+        }
+    }
+    return severity::info;
+}
+
+// BDL_LOG(logger, BDL::severity::warn, "text", value...): nothing is evaluated below the compile time
+// minimum or the logger's runtime threshold
+#define BDL_LOG(logger, level, ...) \
+    do { \
+        if constexpr (BDL::severityCompiledIn(level)) { \
+            if ((logger).shouldLog(level)) { \
+                (logger).logMessage(level, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+// Sampled and rate limited variants, each statement keeps its own counters:
+// BDL_LOG_EVERY_N(logger, level, 100, ...) logs the 1st, 101st, 201st ... call,
+// BDL_LOG_FIRST_N(logger, level, 10, ...) only the first 10 calls,
+// BDL_LOG_RATE(logger, level, 5, ...) at most 5 calls per second on average.
+// Counts still pending when a burst ends are logged by the next output after the summary
+// interval, by logSuppressed(), and by the destructor of an async or shared backend logger
+#define BDL_LOG_LIMITED(logger, level, check, limit, ...) \
+    do { \
+        if constexpr (BDL::severityCompiledIn(level)) { \
+            static BDL::callSiteLimiter bdlCallSite(__FILE__, __LINE__, level); \
+            if ((logger).shouldLog(level)) { \
+                unsigned long long bdlSuppressed = 0; \
+                if (bdlCallSite.check(limit, bdlSuppressed)) { \
+                    (logger).logMessage(level, __VA_ARGS__); \
+                } \
+                else { \
+                    (logger).trackCallSite(bdlCallSite); \
+                } \
+                if (bdlSuppressed) { \
+                    (logger).logMessage(level, "Suppressed ", bdlSuppressed, " messages at " __FILE__ ":", __LINE__); \
+                } \
+            } \
+        } \
+    } while (0)
+// BDL_LOG_CAT(logger, netCategory, BDL::severity::debug, "sent ", bytes): only evaluated when the
+// category is enabled at that level, see loggerConstructor::addCategory()
+#define BDL_LOG_CAT(logger, category, level, ...) \
+    do { \
+        if constexpr (BDL::severityCompiledIn(level)) { \
+            if ((logger).shouldLog(category, level)) { \
+                (logger).logCategory(category, level, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+// BDL_SCOPE(logger, "db.query"): times the rest of the enclosing block, see
+// loggerConstructor::setScopeThreshold(), setScopeStats() and setScopeTraceFile()
+#define BDL_SCOPE_CONCAT2(a, b) a##b
+#define BDL_SCOPE_CONCAT(a, b) BDL_SCOPE_CONCAT2(a, b)
+#define BDL_SCOPE(logger, name) \
+    static BDL::scopeSite BDL_SCOPE_CONCAT(bdlScopeSite, __LINE__)(name); \
+    BDL::scopeTimer BDL_SCOPE_CONCAT(bdlScope, __LINE__)((logger), BDL_SCOPE_CONCAT(bdlScopeSite, __LINE__))
+#define BDL_LOG_EVERY_N(logger, level, n, ...) BDL_LOG_LIMITED(logger, level, everyN, n, __VA_ARGS__)
+#define BDL_LOG_FIRST_N(logger, level, n, ...) BDL_LOG_LIMITED(logger, level, firstN, n, __VA_ARGS__)
+#define BDL_LOG_RATE(logger, level, perSecond, ...) BDL_LOG_LIMITED(logger, level, rate, perSecond, __VA_ARGS__)
+#if BDL_MIN_LEVEL <= BDL_LEVEL_TRACE
+#define BDL_TRACE(logger, ...) BDL_LOG(logger, BDL::severity::trace, __VA_ARGS__)
+#else
+#define BDL_TRACE(logger, ...) ((void)0)
+#endif
+#if BDL_MIN_LEVEL <= BDL_LEVEL_DEBUG
+#define BDL_DEBUG(logger, ...) BDL_LOG(logger, BDL::severity::debug, __VA_ARGS__)
+#else
+#define BDL_DEBUG(logger, ...) ((void)0)
+#endif
+#if BDL_MIN_LEVEL <= BDL_LEVEL_INFO
+#define BDL_INFO(logger, ...) BDL_LOG(logger, BDL::severity::info, __VA_ARGS__)
+#else
+#define BDL_INFO(logger, ...) ((void)0)
+#endif
+#if BDL_MIN_LEVEL <= BDL_LEVEL_WARN
+#define BDL_WARN(logger, ...) BDL_LOG(logger, BDL::severity::warn, __VA_ARGS__)
+#else
+#define BDL_WARN(logger, ...) ((void)0)
+#endif
+#if BDL_MIN_LEVEL <= BDL_LEVEL_ERROR
+#define BDL_ERROR(logger, ...) BDL_LOG(logger, BDL::severity::error, __VA_ARGS__)
+#else
+#define BDL_ERROR(logger, ...) ((void)0)
+#endif
+#if BDL_MIN_LEVEL <= BDL_LEVEL_FATAL
+#define BDL_FATAL(logger, ...) BDL_LOG(logger, BDL::severity::fatal, __VA_ARGS__)
+#else
+#define BDL_FATAL(logger, ...) ((void)0)
+#endif
+
+//Size in bytes of one main buffer chunk
+#ifndef BDL_CHUNK_SIZE
+#define BDL_CHUNK_SIZE (64 * 1024)
+#endif
+
+//Size in bytes of one preallocated lock-free record slot (header included)
+#ifndef BDL_RING_SLOT_SIZE
+#define BDL_RING_SLOT_SIZE 256
+#endif
+
+// Bounded multi-producer/single-consumer ring of preallocated record slots.
+// Producers claim a slot with one CAS on head and copy their record in,
+// the consumer (always called with the logger mutex held) drains slots in order.
+class mpscRing {
+public:
+    struct alignas(64) slot {
+        std::atomic<size_t> sequence;
+        unsigned long long timestamp; // Log time of a text record, 0 if not stamped
+        unsigned short length;
+        unsigned short messageOffset;
+        unsigned short messageLength;
+        unsigned char kind;
+        unsigned char level;
+        char data[BDL_RING_SLOT_SIZE - sizeof(std::atomic<size_t>) - sizeof(unsigned long long) - 3 * sizeof(unsigned short) - 2];
+    };
+    static constexpr size_t payloadSize = sizeof(slot::data);
+    static constexpr unsigned char textRecord = 0;
+    static constexpr unsigned char binaryRecord = 1;
+    static constexpr unsigned char structuredRecord = 2;
+private:
+    std::unique_ptr<slot[]> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) size_t tail = 0;
+public:
+    void reserve(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.reset(new slot[size]);
+        for (size_t i = 0; i < size; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mask = size - 1;
+        head.store(0, std::memory_order_relaxed);
+        tail = 0;
+    }
+    size_t capacity() const {
+        return slots ? mask + 1 : 0;
+    }
+    // Returns nullptr when the ring is full
+    slot* claim() {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            slot& s = slots[pos & mask];
+            size_t seq = s.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return &s;
+                }
+            }
+            else if (diff < 0) {
+                return nullptr;
+            }
+            else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    void publish(slot* s) {
+        s->sequence.store(s->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    // Single consumer only; stops at the first slot that was claimed but not yet published.
+    // With waitForClaimed it waits for the slots claimed before the call instead, so a producer
+    // falling back to the locked path cannot overtake its own records behind a slower one
+    template <class Consumer>
+    size_t drain(Consumer&& consume, bool waitForClaimed = false) {
+        size_t count = 0;
+        size_t claimed = waitForClaimed ? head.load(std::memory_order_acquire) : 0;
+        while (slots) {
+            slot& s = slots[tail & mask];
+            if (s.sequence.load(std::memory_order_acquire) != tail + 1) {
+                if (tail < claimed) { // Its producer is copying the record in right now
+                    std::this_thread::yield();
+                    continue;
+                }
+                break;
+            }
+            consume(s);
+            s.sequence.store(tail + mask + 1, std::memory_order_release);
+            ++tail;
+            ++count;
+        }
+        return count;
+    }
+};
+
+// Clock used for timestamps: system_clock, CLOCK_REALTIME_COARSE (falls back to system_clock
+// where unavailable) or the TSC calibrated against the realtime clock (x86 only)
+enum class clockSource : unsigned char {
+    system,
+    coarse,
+    tsc
+};
+
+class timestampClock {
+private:
+    static unsigned long long systemNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+#ifdef BDL_HAS_TSC
+    // Realtime clock reading the TSC time of one thread is extrapolated from
+    struct tscAnchor {
+        unsigned long long ticks = 0;
+        unsigned long long nanos = 0;
+        unsigned long long secondEnd = 0; // Re-anchored once the extrapolated time gets here
+    };
+    // Tick rate, measured once over ~10 ms by calibrate() or the first use of the TSC clock
+    static double nanosPerTick() {
+        static const double rate = [] {
+            unsigned long long startNanos = systemNanos();
+            unsigned long long startTicks = __rdtsc();
+            unsigned long long endNanos = startNanos;
+            while (endNanos - startNanos < 10000000ULL) {
+                endNanos = systemNanos();
+            }
+            unsigned long long endTicks = __rdtsc();
+            return static_cast<double>(endNanos - startNanos) / static_cast<double>(endTicks - startTicks);
+        }();
+        return rate;
+    }
+    // Every thread re-reads the realtime clock once per second of TSC time, so the rate error
+    // and NTP adjustments never add up to more than a second's worth
+    static unsigned long long tscNanos() {
+        thread_local tscAnchor anchor;
+        double rate = nanosPerTick();
+        unsigned long long nanos = anchor.nanos + static_cast<unsigned long long>(static_cast<double>(__rdtsc() - anchor.ticks) * rate);
+        if (nanos >= anchor.secondEnd) {
+            anchor.ticks = __rdtsc();
+            anchor.nanos = systemNanos();
+            anchor.secondEnd = (anchor.nanos / 1000000000ULL + 1) * 1000000000ULL;
+            nanos = anchor.nanos;
+        }
+        return nanos;
+    }
+#endif
+public:
+    // Measures the TSC rate now, so the first timestamp does not spin for it. No-op without a TSC
+    static void calibrate() {
+#ifdef BDL_HAS_TSC
+        nanosPerTick();
+#endif
+    }
+    // Nanoseconds since the epoch
+    static unsigned long long now(clockSource source) {
+        switch (source) {
+        case clockSource::coarse: {
+#ifdef CLOCK_REALTIME_COARSE
+            timespec ts;
+            clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+            return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + static_cast<unsigned long long>(ts.tv_nsec);
+#else
+            return systemNanos();
+#endif
+        }
+        case clockSource::tsc: {
+#ifdef BDL_HAS_TSC
+            return tscNanos();
+#else
+            return systemNanos();
+#endif
+        }
+        default:
+            return systemNanos();
+        }
+    }
+};
+
+// Writes value as exactly width zero padded digits
+inline void writeDigits(char* out, unsigned long long value, unsigned width) {
+    for (unsigned i = width; i > 0; --i) {
+        out[i - 1] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+//Longest timestamp text: "YYYY-MM-DD HH:MM:SS.nnnnnnnnn"
+#define BDL_TIMESTAMP_MAX 29
+
+// Per-thread cache of the formatted local date and time: the text is rebuilt at most once per
+// second, every other call only patches in the sub-second digits
+class timestampCache {
+private:
+    long long cachedSecond = -1;
+    std::tm fields{};
+    char text[19];
+public:
+    static timestampCache& local() {
+        thread_local timestampCache cache;
+        return cache;
+    }
+    const std::tm& refresh(unsigned long long nanos) {
+        long long second = static_cast<long long>(nanos / 1000000000ULL);
+        if (second != cachedSecond) {
+            std::time_t seconds = static_cast<std::time_t>(second);
+#ifdef _WIN32
+            localtime_s(&fields, &seconds);
+#else
+            localtime_r(&seconds, &fields);
+#endif
+            writeDigits(text, static_cast<unsigned long long>(fields.tm_year + 1900), 4);
+            text[4] = '-';
+            writeDigits(text + 5, static_cast<unsigned long long>(fields.tm_mon + 1), 2);
+            text[7] = '-';
+            writeDigits(text + 8, static_cast<unsigned long long>(fields.tm_mday), 2);
+            text[10] = ' ';
+            writeDigits(text + 11, static_cast<unsigned long long>(fields.tm_hour), 2);
+            text[13] = ':';
+            writeDigits(text + 14, static_cast<unsigned long long>(fields.tm_min), 2);
+            text[16] = ':';
+            writeDigits(text + 17, static_cast<unsigned long long>(fields.tm_sec), 2);
+            cachedSecond = second;
+        }
+        return fields;
+    }
+    // Writes "YYYY-MM-DD HH:MM:SS[.digits]" (digits 0-9), returns the length written
+    size_t format(unsigned long long nanos, unsigned digits, char* out) {
+        refresh(nanos);
+        std::memcpy(out, text, sizeof(text));
+        if (!digits) {
+            return sizeof(text);
+        }
+        digits = std::min(digits, 9u);
+        unsigned long long fraction = nanos % 1000000000ULL;
+        for (unsigned i = digits; i < 9; ++i) {
+            fraction /= 10;
+        }
+        out[sizeof(text)] = '.';
+        writeDigits(out + sizeof(text) + 1, fraction, digits);
+        return sizeof(text) + 1 + digits;
+    }
+};
+
+// Numeric id of the calling thread (the kernel tid on Linux), cached per thread
+inline unsigned long long currentThreadId() {
+#ifdef __linux__
+    thread_local unsigned long long id = static_cast<unsigned long long>(::syscall(SYS_gettid));
+#else
+    thread_local unsigned long long id = std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+    return id;
+}
+inline void appendDigits(std::string& out, unsigned long long value, unsigned width) {
+    size_t offset = out.size();
+    out.resize(offset + width);
+    writeDigits(&out[offset], value, width);
+}
+inline void appendNumber(std::string& out, unsigned long long value) {
+    char digits[20];
+    unsigned width = 0;
+    do {
+        digits[sizeof(digits) - ++width] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+    out.append(digits + sizeof(digits) - width, width);
+}
+
+// Appends one argument of logMessage(args...)/logf() as text, using std::to_chars for numbers
+template <class T>
+void appendValue(std::string& out, const T& value) {
+    using U = std::decay_t<T>;
+    char digits[64];
+    if constexpr (std::is_same_v<U, bool>) {
+        out.append(value ? "true" : "false");
+    }
+    else if constexpr (std::is_same_v<U, char>) {
+        out += value;
+    }
+    else if constexpr (std::is_enum_v<U>) {
+        appendValue(out, static_cast<std::underlying_type_t<U>>(value));
+    }
+    else if constexpr (std::is_integral_v<U>) {
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+    }
+    else if constexpr (std::is_floating_point_v<U>) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+#else
+        out.append(digits, static_cast<size_t>(std::snprintf(digits, sizeof(digits), "%.17g", static_cast<double>(value))));
+#endif
+    }
+    else if constexpr (std::is_array_v<T>) {
+        out.append(value); // String literals and char arrays
+    }
+    else if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+        out.append(value ? value : "(null)");
+    }
+    else if constexpr (std::is_convertible_v<const U&, std::string_view>) {
+        out.append(std::string_view(value));
+    }
+    else {
+        static_assert(std::is_pointer_v<U>, "BDL: unsupported log argument type");
+        out.append("0x");
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), reinterpret_cast<std::uintptr_t>(value), 16).ptr);
+    }
+}
+// Replaces each "{}" in format with the next argument, extra arguments are ignored
+inline void appendFormatted(std::string& out, std::string_view format) {
+    out.append(format);
+}
+template <class T, class... Rest>
+void appendFormatted(std::string& out, std::string_view format, const T& first, const Rest&... rest) {
+    size_t placeholder = format.find("{}");
+    if (placeholder == std::string_view::npos) {
+        out.append(format);
+        return;
+    }
+    out.append(format.substr(0, placeholder));
+    appendValue(out, first);
+    appendFormatted(out, format.substr(placeholder + 2), rest...);
+}
+
+// A log line pattern compiled once into a list of steps, e.g. "%Y-%m-%d %H:%M:%S [%L] %T %v".
+// %Y %m %d %H %M %S date and time, %e %f %F milli/micro/nanoseconds, %L level name,
+// %T thread id, %C category name, %v message, %% a literal '%'. Everything else is copied as is.
+class linePattern {
+private:
+    struct step {
+        char field; // 0 for literal text
+        unsigned short offset;
+        unsigned short length;
+    };
+    std::string text;
+    std::vector<step> steps;
+    bool usesTime = false;
+public:
+    // Returns false if the pattern has no %v, the message is then appended at the end
+    bool compile(const std::string& pattern) {
+        text = pattern;
+        steps.clear();
+        usesTime = false;
+        bool hasMessage = false;
+        size_t literalStart = 0;
+        auto flushLiteral = [&](size_t end) {
+            if (end > literalStart) {
+                steps.push_back({ 0, static_cast<unsigned short>(literalStart), static_cast<unsigned short>(end - literalStart) });
+            }
+        };
+        for (size_t i = 0; i + 1 < text.size(); ++i) {
+            if (text[i] != '%') {
+                continue;
+            }
+            char field = text[i + 1];
+            switch (field) {
+            case 'Y': case 'm': case 'd': case 'H': case 'M': case 'S': case 'e': case 'f': case 'F':
+                usesTime = true;
+                [[fallthrough]];
+            case 'L': case 'T': case 'C': case 'v':
+                flushLiteral(i);
+                steps.push_back({ field, 0, 0 });
+                hasMessage = hasMessage || field == 'v';
+                literalStart = i + 2;
+                ++i;
+                break;
+            case '%':
+                flushLiteral(i + 1); // Keeps one '%'
+                literalStart = i + 2;
+                ++i;
+                break;
+            default:
+                break;
+            }
+        }
+        flushLiteral(text.size());
+        if (!hasMessage) {
+            steps.push_back({ 'v', 0, 0 });
+        }
+        return hasMessage;
+    }
+    bool empty() const {
+        return steps.empty();
+    }
+    bool showsTime() const {
+        return usesTime;
+    }
+    // Appends one rendered line (without the newline) to out, returns the message offset in out
+    size_t render(std::string& out, clockSource source, std::string_view levelName, std::string_view message,
+                  std::string_view categoryName = {}) const {
+        return renderAt(out, usesTime ? timestampClock::now(source) : 0, 0, levelName, message, categoryName);
+    }
+    // Same for a record captured earlier: nanos and threadId as recorded (threadId 0 is the calling thread)
+    size_t renderAt(std::string& out, unsigned long long nanos, unsigned long long threadId, std::string_view levelName,
+                    std::string_view message, std::string_view categoryName = {}) const {
+        const std::tm* fields = usesTime ? &timestampCache::local().refresh(nanos) : nullptr;
+        size_t messageOffset = out.size();
+        for (const step& s : steps) {
+            switch (s.field) {
+            case 0: out.append(text, s.offset, s.length); break;
+            case 'Y': appendDigits(out, static_cast<unsigned long long>(fields->tm_year + 1900), 4); break;
+            case 'm': appendDigits(out, static_cast<unsigned long long>(fields->tm_mon + 1), 2); break;
+            case 'd': appendDigits(out, static_cast<unsigned long long>(fields->tm_mday), 2); break;
+            case 'H': appendDigits(out, static_cast<unsigned long long>(fields->tm_hour), 2); break;
+            case 'M': appendDigits(out, static_cast<unsigned long long>(fields->tm_min), 2); break;
+            case 'S': appendDigits(out, static_cast<unsigned long long>(fields->tm_sec), 2); break;
+            case 'e': appendDigits(out, nanos % 1000000000ULL / 1000000ULL, 3); break;
+            case 'f': appendDigits(out, nanos % 1000000000ULL / 1000ULL, 6); break;
+            case 'F': appendDigits(out, nanos % 1000000000ULL, 9); break;
+            case 'L': out.append(levelName); break;
+            case 'T': appendNumber(out, threadId ? threadId : currentThreadId()); break;
+            case 'C': out.append(categoryName); break;
+            case 'v':
+                messageOffset = out.size();
+                out.append(message);
+                break;
+            }
+        }
+        return messageOffset;
+    }
+};
+
+//Characters of a deduplicated message kept for its "repeated N times" summary
+#ifndef BDL_LOOP_PREVIEW_SIZE
+#define BDL_LOOP_PREVIEW_SIZE 48
+#endif
+
+// 64-bit FNV-1a, used to identify messages without keeping copies of them
+inline unsigned long long hashMessage(std::string_view message) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (char c : message) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Fixed-size loop check table: 8-way buckets of message hashes (one cache line per bucket)
+// with CLOCK eviction, so memory and lookup cost do not depend on how many distinct messages
+// were logged. Suppressed repeats are counted and reported through the summary callback.
+class loopCheckTable {
+private:
+    static constexpr size_t ways = 8;
+    struct alignas(64) bucket {
+        unsigned long long hashes[ways];
+    };
+    struct entryInfo {
+        unsigned repeats;
+        unsigned char referenced;
+        unsigned char previewLength;
+        char preview[BDL_LOOP_PREVIEW_SIZE];
+    };
+    std::vector<bucket> buckets;
+    std::vector<entryInfo> info;
+    std::vector<unsigned char> hands;
+    size_t mask = 0;
+    size_t pendingRepeats = 0;
+
+    template <class Summary>
+    void reportInternal(entryInfo& entry, Summary& summary) {
+        if (entry.repeats) {
+            summary(entry.repeats, std::string_view(entry.preview, entry.previewLength));
+            entry.repeats = 0;
+        }
+    }
+public:
+    void reset(size_t capacity) {
+        size_t count = 1;
+        while (count * ways < capacity) {
+            count <<= 1;
+        }
+        buckets.assign(count, bucket{});
+        info.assign(count * ways, entryInfo{});
+        hands.assign(count, 0);
+        mask = count - 1;
+        pendingRepeats = 0;
+    }
+    void clear() {
+        reset(buckets.size() * ways);
+    }
+    // True if the message was already seen (the repeat is counted), false if it was just added.
+    // An evicted entry with pending repeats is reported through summary first.
+    template <class Summary>
+    bool seen(std::string_view message, Summary&& summary) {
+        if (buckets.empty()) {
+            reset(1024);
+        }
+        unsigned long long hash = hashMessage(message) | 1; // 0 marks an empty way
+        size_t index = hash & mask;
+        bucket& b = buckets[index];
+        entryInfo* entries = &info[index * ways];
+        for (size_t way = 0; way < ways; ++way) {
+            if (b.hashes[way] == hash) {
+                ++entries[way].repeats;
+                ++pendingRepeats;
+                entries[way].referenced = 1;
+                return true;
+            }
+        }
+        size_t way = hands[index];
+        while (b.hashes[way] && entries[way].referenced) { // CLOCK: give referenced entries a second chance
+            entries[way].referenced = 0;
+            way = (way + 1) % ways;
+        }
+        reportInternal(entries[way], summary);
+        hands[index] = static_cast<unsigned char>((way + 1) % ways);
+        b.hashes[way] = hash;
+        entries[way].referenced = 1;
+        entries[way].previewLength = static_cast<unsigned char>(std::min<size_t>(message.size(), BDL_LOOP_PREVIEW_SIZE));
+        std::memcpy(entries[way].preview, message.data(), entries[way].previewLength);
+        return false;
+    }
+    // Reports and resets the repeat counts of all entries, the entries stay in the table
+    template <class Summary>
+    void takeRepeats(Summary&& summary) {
+        if (!pendingRepeats) {
+            return;
+        }
+        pendingRepeats = 0;
+        for (entryInfo& entry : info) {
+            reportInternal(entry, summary);
+        }
+    }
+};
+
+// Per-call-site sampling and rate limiting, one static instance per BDL_LOG_EVERY_N,
+// BDL_LOG_FIRST_N or BDL_LOG_RATE statement. Decides on call counts and time only, the message
+// is never formatted or hashed for a suppressed call. Suppressed calls are reported as
+// "Suppressed K messages at file:line" at most every BDL_SUPPRESS_SUMMARY_SECONDS, by the
+// statement itself or by the output of the first logger that suppressed a call there.
+#ifndef BDL_SUPPRESS_SUMMARY_SECONDS
+#define BDL_SUPPRESS_SUMMARY_SECONDS 10
+#endif
+class callSiteLimiter {
+private:
+    std::atomic<unsigned long long> calls{ 0 };
+    std::atomic<unsigned long long> allowedAt{ 0 }; // GCRA theoretical arrival time, ns
+    std::atomic<unsigned long long> suppressed{ 0 };
+    std::atomic<unsigned long long> lastSummary{ 0 };
+
+    static unsigned long long nowInternal() {
+        return timestampClock::now(clockSource::coarse);
+    }
+    // Returns the count to report once the summary interval is up, 0 otherwise
+    unsigned long long summaryDueInternal() {
+        unsigned long long now = nowInternal();
+        unsigned long long last = lastSummary.load(std::memory_order_relaxed);
+        if (last && now - last < BDL_SUPPRESS_SUMMARY_SECONDS * 1000000000ULL) {
+            return 0;
+        }
+        if (!lastSummary.compare_exchange_strong(last, now, std::memory_order_relaxed) || !last) {
+            return 0; // Another call reports, or the first interval just started
+        }
+        return suppressed.exchange(0, std::memory_order_relaxed);
+    }
+    bool decideInternal(bool allowed, unsigned long long& summary) {
+        if (allowed) {
+            if (suppressed.load(std::memory_order_relaxed)) {
+                summary = summaryDueInternal();
+            }
+            return true;
+        }
+        if ((suppressed.fetch_add(1, std::memory_order_relaxed) & 63) == 0) { // Clock read on every 64th only
+            summary = summaryDueInternal();
+        }
+        return false;
+    }
+public:
+    const char* file;
+    unsigned line;
+    severity level;
+    std::atomic<const void*> owner{ nullptr }; // Logger reporting the count once the statement goes quiet
+
+    callSiteLimiter(const char* siteFile, unsigned siteLine, severity siteLevel) : file(siteFile), line(siteLine), level(siteLevel) {}
+    // Count to report from the output, only once the summary interval is up unless forced
+    unsigned long long pendingSummary(bool force) {
+        if (!suppressed.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+        return force ? suppressed.exchange(0, std::memory_order_relaxed) : summaryDueInternal();
+    }
+    // summary is set to the number of calls to report as suppressed, when a summary is due
+    bool everyN(unsigned long long n, unsigned long long& summary) {
+        return decideInternal(n <= 1 || calls.fetch_add(1, std::memory_order_relaxed) % n == 0, summary);
+    }
+    bool firstN(unsigned long long n, unsigned long long& summary) {
+        // Plain load first, so a site that is done logging stops writing the shared counter
+        bool allowed = calls.load(std::memory_order_relaxed) < n && calls.fetch_add(1, std::memory_order_relaxed) < n;
+        return decideInternal(allowed, summary);
+    }
+    // Token bucket (GCRA): perSecond calls per second on average, bursts of up to perSecond calls
+    bool rate(double perSecond, unsigned long long& summary) {
+        if (perSecond <= 0) {
+            return decideInternal(false, summary);
+        }
+        unsigned long long interval = static_cast<unsigned long long>(1e9 / perSecond);
+        unsigned long long tolerance = interval < 1000000000ULL ? 1000000000ULL - interval : 0;
+        unsigned long long now = nowInternal();
+        unsigned long long arrival = allowedAt.load(std::memory_order_relaxed);
+        bool allowed;
+        do {
+            unsigned long long base = std::max(arrival, now);
+            allowed = base - now <= tolerance;
+            if (!allowed) {
+                break;
+            }
+            if (allowedAt.compare_exchange_weak(arrival, base + interval, std::memory_order_relaxed)) {
+                break;
+            }
+        } while (true);
+        return decideInternal(allowed, summary);
+    }
+};
+
+//Most categories one logger can have (at most 64, one bit each)
+#ifndef BDL_MAX_CATEGORIES
+#define BDL_MAX_CATEGORIES 64
+#endif
+using categoryId = unsigned;
+
+// Named categories of one logger. Whether a category is on is one bit of an atomic mask and its
+// threshold an atomic level, so both can be switched at runtime while producers check them.
+// Names and prefixes are fixed once added
+class categoryTable {
+private:
+    static_assert(BDL_MAX_CATEGORIES <= 64, "BDL: at most 64 categories");
+    struct entry {
+        std::string name;
+        std::string prefixes[BDL_LEVEL_OFF + 1]; // "[DEBUG][net]" for every level
+        std::atomic<unsigned char> minLevel{ BDL_LEVEL_TRACE };
+    };
+    std::unique_ptr<entry[]> entries;
+    std::atomic<unsigned> count = 0;
+    std::atomic<unsigned long long> enabled = 0;
+    std::mutex mtx; // Adding categories and applying configurations
+
+    static std::string_view trim(std::string_view text) {
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+    // Sets one category from a config value: on, off or a level name
+    bool applyValueInternal(categoryId id, std::string_view value) {
+        std::string upper(value);
+        for (char& c : upper) {
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        if (upper == "ON" || upper == "OFF") {
+            enable(id, upper == "ON");
+            return true;
+        }
+        for (unsigned i = BDL_LEVEL_TRACE; i < BDL_LEVEL_OFF; ++i) {
+            if (upper == severityName(static_cast<severity>(i)) || (upper == "WARNING" && i == BDL_LEVEL_WARN)) {
+                setLevel(id, static_cast<severity>(i));
+                enable(id, true);
+                return true;
+            }
+        }
+        return false;
+    }
+public:
+    // Returns the id of name (the existing one if it was added before), BDL_MAX_CATEGORIES if full
+    categoryId add(const std::string& name, severity minLevel, bool on) {
+        std::lock_guard<std::mutex> lock(mtx);
+        categoryId existing = find(name);
+        if (existing != BDL_MAX_CATEGORIES) {
+            return existing;
+        }
+        unsigned id = count.load(std::memory_order_relaxed);
+        if (id == BDL_MAX_CATEGORIES) {
+            return BDL_MAX_CATEGORIES;
+        }
+        if (!entries) {
+            entries.reset(new entry[BDL_MAX_CATEGORIES]);
+        }
+        entries[id].name = name;
+        for (unsigned i = 0; i <= BDL_LEVEL_OFF; ++i) {
+            entries[id].prefixes[i] = std::string(severityPrefix(static_cast<severity>(i))) + '[' + name + ']';
+        }
+        entries[id].minLevel.store(static_cast<unsigned char>(minLevel), std::memory_order_relaxed);
+        count.store(id + 1, std::memory_order_release);
+        enable(id, on);
+        return id;
+    }
+    categoryId find(std::string_view name) const {
+        unsigned added = count.load(std::memory_order_acquire);
+        for (unsigned id = 0; id < added; ++id) {
+            if (entries[id].name == name) {
+                return id;
+            }
+        }
+        return BDL_MAX_CATEGORIES;
+    }
+    // The producer check: one bit and one level, no locks
+    bool enabledAt(categoryId id, severity level) const {
+        return id < BDL_MAX_CATEGORIES && ((enabled.load(std::memory_order_relaxed) >> id) & 1)
+            && static_cast<unsigned char>(level) >= entries[id].minLevel.load(std::memory_order_relaxed);
+    }
+    void enable(categoryId id, bool on) {
+        if (id >= count.load(std::memory_order_acquire)) {
+            return;
+        }
+        if (on) {
+            enabled.fetch_or(1ULL << id, std::memory_order_relaxed);
+        }
+        else {
+            enabled.fetch_and(~(1ULL << id), std::memory_order_relaxed);
+        }
+    }
+    void setLevel(categoryId id, severity level) {
+        if (id < count.load(std::memory_order_acquire)) {
+            entries[id].minLevel.store(static_cast<unsigned char>(level), std::memory_order_relaxed);
+        }
+    }
+    // Only valid for ids returned by add()
+    std::string_view name(categoryId id) const {
+        return entries[id].name;
+    }
+    std::string_view prefix(categoryId id, severity level) const {
+        return entries[id].prefixes[static_cast<unsigned char>(level) <= BDL_LEVEL_OFF ? static_cast<unsigned char>(level) : BDL_LEVEL_OFF];
+    }
+    // Applies "name = value" lines, value being on, off or a level name (which also turns the
+    // category on). '*' stands for every category, '#' starts a comment. Returns the number of
+    // lines that were not understood
+    unsigned apply(std::string_view config) {
+        std::lock_guard<std::mutex> lock(mtx);
+        unsigned errors = 0;
+        while (!config.empty()) {
+            size_t end = config.find('\n');
+            std::string_view line = config.substr(0, end);
+            config.remove_prefix(end == std::string_view::npos ? config.size() : end + 1);
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) {
+                continue;
+            }
+            size_t equals = line.find('=');
+            if (equals == std::string_view::npos) {
+                ++errors;
+                continue;
+            }
+            std::string_view name = trim(line.substr(0, equals));
+            std::string_view value = trim(line.substr(equals + 1));
+            if (name == "*") {
+                unsigned added = count.load(std::memory_order_relaxed);
+                for (categoryId id = 0; id < added; ++id) {
+                    errors += applyValueInternal(id, value) ? 0 : 1;
+                }
+                continue;
+            }
+            categoryId id = find(name);
+            if (id == BDL_MAX_CATEGORIES || !applyValueInternal(id, value)) {
+                ++errors;
+            }
+        }
+        return errors;
+    }
+};
+
+#ifdef BDL_POSIX
+// File sink writing into preallocated, memory-mapped segments: a flush is a memcpy into the
+// mapping, no syscall. A full segment is truncated to its size and rotated to <path>.1,
+// older files move up by one and anything past maxFiles is deleted.
+class mappedFileSink {
+private:
+    std::string path;
+    size_t segmentSize = 64 * 1024 * 1024;
+    unsigned maxFiles = 4;
+    int fd = -1;
+    char* mapping = nullptr;
+    size_t used = 0;
+
+    bool mapSegmentInternal() {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            // Nothing mapped: unmapSegmentInternal() must not truncate this file to the old segment's size
+            ::close(fd);
+            fd = -1;
+            used = 0;
+            return false;
+        }
+        used = static_cast<size_t>(info.st_size);
+        if (used >= segmentSize) { // Full, or left preallocated by a crashed run
+            ::close(fd);
+            fd = -1;
+            rotateFilesInternal();
+            return mapSegmentInternal();
+        }
+#ifdef __linux__
+        if (::posix_fallocate(fd, 0, static_cast<off_t>(segmentSize)) != 0 && ::ftruncate(fd, static_cast<off_t>(segmentSize)) != 0) {
+            return false;
+        }
+#else
+        if (::ftruncate(fd, static_cast<off_t>(segmentSize)) != 0) {
+            return false;
+        }
+#endif
+        void* address = ::mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            return false;
+        }
+        mapping = static_cast<char*>(address);
+        return true;
+    }
+    void unmapSegmentInternal() {
+        if (mapping) {
+            ::munmap(mapping, segmentSize);
+            mapping = nullptr;
+        }
+        if (fd >= 0) {
+            if (::ftruncate(fd, static_cast<off_t>(used)) != 0) { // Drop the unused preallocated tail
+                std::cerr << "Error: Could not truncate " << path << ".\n";
+            }
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    void rotateFilesInternal() {
+        if (maxFiles == 0) {
+            ::unlink(path.c_str());
+            return;
+        }
+        ::unlink((path + '.' + std::to_string(maxFiles)).c_str());
+        for (unsigned i = maxFiles; i > 1; --i) {
+            ::rename((path + '.' + std::to_string(i - 1)).c_str(), (path + '.' + std::to_string(i)).c_str());
+        }
+        ::rename(path.c_str(), (path + ".1").c_str());
+    }
+public:
+    ~mappedFileSink() {
+        close();
+    }
+    bool open(const std::string& fileName, size_t segmentBytes, unsigned keepFiles) {
+        close();
+        path = fileName;
+        segmentSize = segmentBytes;
+        maxFiles = keepFiles;
+        if (!mapSegmentInternal()) {
+            unmapSegmentInternal();
+            return false;
+        }
+        return true;
+    }
+    bool isOpen() const {
+        return mapping != nullptr;
+    }
+    bool write(const char* data, size_t length) {
+        while (length) {
+            if (!mapping) {
+                return false;
+            }
+            size_t chunk = std::min(length, segmentSize - used);
+            bool rotate = chunk < length;
+            if (rotate) { // Keep lines whole, only a line longer than a segment gets split
+                size_t whole = chunk;
+                while (whole > 0 && data[whole - 1] != '\n') {
+                    --whole;
+                }
+                if (whole > 0 || used > 0) {
+                    chunk = whole;
+                }
+            }
+            std::memcpy(mapping + used, data, chunk);
+            used += chunk;
+            data += chunk;
+            length -= chunk;
+            if (rotate || used == segmentSize) {
+                unmapSegmentInternal();
+                rotateFilesInternal();
+                if (!mapSegmentInternal()) {
+                    unmapSegmentInternal();
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    // Waits until the current segment is written back to disk
+    bool sync() {
+        return !mapping || ::msync(mapping, used, MS_SYNC) == 0;
+    }
+    void close() {
+        unmapSegmentInternal();
+    }
+};
+#endif
+
+#ifdef BDL_POSIX
+// Flight recorder: a fixed in-memory ring holding the most recent lines, written out only on a
+// crash or a fatal message. Producers reserve their bytes with one fetch_add and copy the line
+// in. dump() only uses open() and write(), so it is safe to call from a signal handler.
+#define BDL_FLIGHT_MAX_RECORDERS 8
+#define BDL_FLIGHT_PATH_MAX 256
+class flightRecorder {
+private:
+    std::unique_ptr<char[]> ring;
+    size_t mask = 0;
+    std::atomic<unsigned long long> head{ 0 };
+    int fd = STDERR_FILENO;
+    char path[BDL_FLIGHT_PATH_MAX] = {}; // Opened at dump time, so no file exists until a crash
+
+    inline static std::atomic<flightRecorder*> registered[BDL_FLIGHT_MAX_RECORDERS] = {};
+    inline static struct sigaction previous[3];
+    inline static std::atomic<bool> handlersInstalled = false;
+    static constexpr int crashSignals[3] = { SIGSEGV, SIGABRT, SIGBUS };
+
+    static void writeAllInternal(int target, const char* data, size_t length) {
+        while (length) {
+            ssize_t written = ::write(target, data, length);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return;
+            }
+            data += written;
+            length -= static_cast<size_t>(written);
+        }
+    }
+    static void crashHandler(int signal) {
+        for (std::atomic<flightRecorder*>& slot : registered) {
+            if (flightRecorder* recorder = slot.load()) {
+                recorder->dump();
+            }
+        }
+        // Hand the signal on to whatever was installed before (usually the default, a core dump)
+        for (int i = 0; i < 3; ++i) {
+            if (crashSignals[i] == signal) {
+                sigaction(signal, &previous[i], nullptr);
+            }
+        }
+        raise(signal);
+    }
+public:
+    flightRecorder() = default;
+    flightRecorder(const flightRecorder&) = delete;
+    flightRecorder& operator=(const flightRecorder&) = delete;
+    ~flightRecorder() {
+        unregister();
+    }
+    // Rounded up to a power of two
+    void reserve(size_t bytes) {
+        size_t size = 4096;
+        while (size < bytes) {
+            size <<= 1;
+        }
+        ring.reset(new char[size]);
+        mask = size - 1;
+        head.store(0, std::memory_order_relaxed);
+    }
+    bool isOpen() const {
+        return ring != nullptr;
+    }
+    void setFd(int target) {
+        fd = target;
+        path[0] = '\0';
+    }
+    // False if the path does not fit
+    bool setPath(const std::string& file) {
+        if (file.size() >= sizeof(path)) {
+            return false;
+        }
+        std::memcpy(path, file.c_str(), file.size() + 1);
+        return true;
+    }
+    void record(std::string_view line) {
+        size_t size = mask + 1;
+        if (line.size() > size) {
+            line = line.substr(line.size() - size);
+        }
+        unsigned long long start = head.fetch_add(line.size(), std::memory_order_relaxed);
+        size_t offset = static_cast<size_t>(start) & mask;
+        size_t first = std::min(line.size(), size - offset);
+        std::memcpy(ring.get() + offset, line.data(), first);
+        std::memcpy(ring.get(), line.data() + first, line.size() - first);
+    }
+    // Async-signal-safe. Lines still being copied by other threads may come out torn
+    void dump() const {
+        if (!ring) {
+            return;
+        }
+        int target = fd;
+        if (path[0]) {
+            target = ::open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (target < 0) {
+                target = STDERR_FILENO;
+            }
+        }
+        static const char header[] = "---- BDL flight recorder ----\n";
+        static const char footer[] = "---- end of flight recorder ----\n";
+        writeAllInternal(target, header, sizeof(header) - 1);
+        unsigned long long end = head.load(std::memory_order_relaxed);
+        size_t size = mask + 1;
+        unsigned long long start = end > size ? end - size : 0;
+        if (start) { // The oldest line was partly overwritten, start after its end
+            while (start < end && ring[static_cast<size_t>(start) & mask] != '\n') {
+                ++start;
+            }
+            ++start;
+        }
+        while (start < end) {
+            size_t offset = static_cast<size_t>(start) & mask;
+            size_t length = static_cast<size_t>(std::min<unsigned long long>(end - start, size - offset));
+            writeAllInternal(target, ring.get() + offset, length);
+            start += length;
+        }
+        writeAllInternal(target, footer, sizeof(footer) - 1);
+        if (target != fd) {
+            ::close(target);
+        }
+    }
+    // Adds this recorder to the ones dumped on SIGSEGV, SIGABRT and SIGBUS, false if all slots are taken
+    bool registerForCrashes() {
+        if (!handlersInstalled.exchange(true)) {
+            for (int i = 0; i < 3; ++i) {
+                struct sigaction action = {};
+                action.sa_handler = &flightRecorder::crashHandler;
+                sigemptyset(&action.sa_mask);
+                action.sa_flags = SA_RESETHAND;
+                sigaction(crashSignals[i], &action, &previous[i]);
+            }
+        }
+        for (std::atomic<flightRecorder*>& slot : registered) {
+            flightRecorder* expected = slot.load();
+            if (expected == this) {
+                return true;
+            }
+        }
+        for (std::atomic<flightRecorder*>& slot : registered) {
+            flightRecorder* expected = nullptr;
+            if (slot.compare_exchange_strong(expected, this)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    void unregister() {
+        for (std::atomic<flightRecorder*>& slot : registered) {
+            flightRecorder* expected = this;
+            slot.compare_exchange_strong(expected, nullptr);
+        }
+    }
+};
+#endif
+
+// Main buffer kept as a list of fixed-size chunks. A flush hands the chunks straight to the
+// sinks (writev on POSIX) without building an intermediate string, emptied chunks are kept
+// as spares for the next appends.
+class chunkBuffer {
+private:
+    struct chunk {
+        size_t begin = 0; // Moves forward when lines are dropped from the front
+        size_t used = 0;
+        char data[BDL_CHUNK_SIZE];
+    };
+    std::vector<std::unique_ptr<chunk>> chunks;
+    std::vector<std::unique_ptr<chunk>> spares;
+    size_t bytes = 0;
+    // Severity of every byte as runs of consecutive records, lets sinks filter without a re-render.
+    // Structured runs hold encoded records (see encodeStructuredRecord()) instead of text lines.
+    // Text runs also split where the log time of the lines changes, 0 for lines not stamped
+    struct levelRun {
+        size_t bytes;
+        unsigned long long timestamp;
+        severity level;
+        bool structured;
+    };
+    std::vector<levelRun> runs;
+    severity currentLevel = severity::info;
+    unsigned long long currentTimestamp = 0;
+    size_t structuredBytes = 0;
+
+    chunk& tailInternal(size_t need = 1) {
+        if (chunks.empty() || BDL_CHUNK_SIZE - chunks.back()->used < need) {
+            if (spares.empty()) {
+                chunks.emplace_back(new chunk);
+            }
+            else {
+                chunks.push_back(std::move(spares.back()));
+                spares.pop_back();
+            }
+            chunks.back()->begin = 0;
+            chunks.back()->used = 0;
+        }
+        return *chunks.back();
+    }
+public:
+    // Severity and log time of the following appends
+    void setLevel(severity level, unsigned long long timestamp = 0) {
+        currentLevel = level;
+        currentTimestamp = timestamp;
+    }
+    void append(const char* data, size_t length) {
+        bytes += length;
+        if (runs.empty() || runs.back().level != currentLevel || runs.back().structured || runs.back().timestamp != currentTimestamp) {
+            runs.push_back({ 0, currentTimestamp, currentLevel, false });
+        }
+        runs.back().bytes += length;
+        while (length) {
+            chunk& tail = tailInternal();
+            size_t part = std::min(length, BDL_CHUNK_SIZE - tail.used);
+            std::memcpy(tail.data + tail.used, data, part);
+            tail.used += part;
+            data += part;
+            length -= part;
+        }
+    }
+    // One encoded structured record, kept whole within a chunk so it can be decoded in place
+    void appendStructured(std::string_view record, severity level) {
+        chunk& tail = tailInternal(record.size());
+        std::memcpy(tail.data + tail.used, record.data(), record.size());
+        tail.used += record.size();
+        bytes += record.size();
+        structuredBytes += record.size();
+        if (runs.empty() || runs.back().level != level || !runs.back().structured) {
+            runs.push_back({ 0, 0, level, true });
+        }
+        runs.back().bytes += record.size();
+    }
+    bool hasStructured() const {
+        return structuredBytes != 0;
+    }
+    chunkBuffer& operator<<(std::string_view text) {
+        append(text.data(), text.size());
+        return *this;
+    }
+    chunkBuffer& operator<<(char c) {
+        append(&c, 1);
+        return *this;
+    }
+    chunkBuffer& operator<<(unsigned long long value) {
+        char digits[20];
+        unsigned width = 0;
+        do {
+            digits[sizeof(digits) - ++width] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        append(digits + sizeof(digits) - width, width);
+        return *this;
+    }
+    size_t size() const {
+        return bytes;
+    }
+    bool empty() const {
+        return bytes == 0;
+    }
+    // Empties the buffer, the chunks become spares
+    void clear() {
+        for (std::unique_ptr<chunk>& c : chunks) {
+            spares.push_back(std::move(c));
+        }
+        chunks.clear();
+        runs.clear();
+        bytes = 0;
+        structuredBytes = 0;
+    }
+    // Moves the filled chunks to the end of other, the spares stay here
+    void moveTo(chunkBuffer& other) {
+        for (std::unique_ptr<chunk>& c : chunks) {
+            other.chunks.push_back(std::move(c));
+        }
+        other.runs.insert(other.runs.end(), runs.begin(), runs.end());
+        other.bytes += bytes;
+        other.structuredBytes += structuredBytes;
+        chunks.clear();
+        runs.clear();
+        bytes = 0;
+        structuredBytes = 0;
+    }
+    // Drops whole lines (or structured records) from the front until at least wanted bytes are
+    // gone, returns the bytes dropped and adds the number of records to lines
+    size_t dropFront(size_t wanted, size_t& lines) {
+        size_t dropped = 0;
+        while (!chunks.empty() && dropped < wanted) {
+            chunk& c = *chunks.front();
+            const char* start = c.data + c.begin;
+            size_t length;
+            if (runs.front().structured) {
+                unsigned recordLength;
+                std::memcpy(&recordLength, start + 1, sizeof(recordLength));
+                length = recordLength;
+                ++lines;
+            }
+            else {
+                const char* end = static_cast<const char*>(std::memchr(start, '\n', c.used - c.begin));
+                length = end ? static_cast<size_t>(end - start) + 1 : c.used - c.begin;
+                if (end) {
+                    ++lines;
+                }
+                else {
+                    wanted = std::max(wanted, dropped + length + 1); // Finish the line that continues in the next chunk
+                }
+            }
+            c.begin += length;
+            dropped += length;
+            bytes -= length;
+            for (size_t left = length; left;) {
+                size_t part = std::min(left, runs.front().bytes);
+                runs.front().bytes -= part;
+                structuredBytes -= runs.front().structured ? part : 0;
+                left -= part;
+                if (runs.front().bytes == 0) {
+                    runs.erase(runs.begin());
+                }
+            }
+            if (c.begin == c.used) {
+                spares.push_back(std::move(chunks.front()));
+                chunks.erase(chunks.begin());
+            }
+        }
+        return dropped;
+    }
+    // Puts a line in front of everything buffered, in the space freed by dropFront() if it fits
+    void prependLine(std::string_view line, severity level, unsigned long long timestamp = 0) {
+        if (chunks.empty() || chunks.front()->begin < line.size()) {
+            std::unique_ptr<chunk> c;
+            if (spares.empty()) {
+                c.reset(new chunk);
+            }
+            else {
+                c = std::move(spares.back());
+                spares.pop_back();
+            }
+            c->begin = BDL_CHUNK_SIZE;
+            c->used = BDL_CHUNK_SIZE;
+            chunks.insert(chunks.begin(), std::move(c));
+        }
+        chunk& front = *chunks.front();
+        front.begin -= line.size();
+        std::memcpy(front.data + front.begin, line.data(), line.size());
+        bytes += line.size();
+        runs.insert(runs.begin(), { line.size(), timestamp, level, false });
+    }
+    // Takes over the spare chunks of other
+    void recycleFrom(chunkBuffer& other) {
+        for (std::unique_ptr<chunk>& c : other.spares) {
+            spares.push_back(std::move(c));
+        }
+        other.spares.clear();
+    }
+    template <class Writer>
+    void forEachChunk(Writer&& write) const {
+        for (const std::unique_ptr<chunk>& c : chunks) {
+            write(c->data + c->begin, c->used - c->begin);
+        }
+    }
+    // Like forEachChunk() but skips the records below minLevel and tells text and structured
+    // spans apart: write(data, length, structured, level, timestamp). Adjacent records of the same
+    // kind are still written in one piece, a structured span always holds whole records. With
+    // splitRuns a span only holds records of one level and text lines of one log time, otherwise
+    // level and timestamp are the first record's
+    template <class Writer>
+    void forEachSpan(severity minLevel, Writer&& write, bool splitRuns = false) const {
+        const char* pending = nullptr;
+        size_t pendingLength = 0;
+        bool pendingStructured = false;
+        severity pendingLevel = minLevel;
+        unsigned long long pendingTimestamp = 0;
+        size_t index = 0;
+        size_t offset = chunks.empty() ? 0 : chunks[0]->begin;
+        for (const levelRun& run : runs) {
+            bool wanted = run.level >= minLevel;
+            for (size_t left = run.bytes; left;) {
+                const chunk& c = *chunks[index];
+                size_t part = std::min(left, c.used - offset);
+                if (wanted && pending && pendingStructured == run.structured && pending + pendingLength == c.data + offset
+                    && (!splitRuns || (pendingLevel == run.level && pendingTimestamp == run.timestamp))) {
+                    pendingLength += part;
+                }
+                else if (wanted) {
+                    if (pendingLength) {
+                        write(pending, pendingLength, pendingStructured, pendingLevel, pendingTimestamp);
+                    }
+                    pending = c.data + offset;
+                    pendingLength = part;
+                    pendingStructured = run.structured;
+                    pendingLevel = run.level;
+                    pendingTimestamp = run.timestamp;
+                }
+                offset += part;
+                left -= part;
+                if (offset == c.used && ++index < chunks.size()) {
+                    offset = chunks[index]->begin;
+                }
+            }
+        }
+        if (pendingLength) {
+            write(pending, pendingLength, pendingStructured, pendingLevel, pendingTimestamp);
+        }
+    }
+#ifdef BDL_POSIX
+    // Writes the chunks of several buffers to fd in order, up to 64 chunks per writev
+    static bool writeAllTo(int fd, const chunkBuffer* const* buffers, size_t count) {
+        iovec batch[64];
+        int filled = 0;
+        for (size_t i = 0; i < count; ++i) {
+            for (const std::unique_ptr<chunk>& c : buffers[i]->chunks) {
+                if (filled == 64) {
+                    if (!writevInternal(fd, batch, filled)) {
+                        return false;
+                    }
+                    filled = 0;
+                }
+                batch[filled].iov_base = c->data + c->begin;
+                batch[filled].iov_len = c->used - c->begin;
+                ++filled;
+            }
+        }
+        return writevInternal(fd, batch, filled);
+    }
+    // Writes every chunk to fd with writev, retrying short writes
+    bool writeTo(int fd) const {
+        const chunkBuffer* self = this;
+        return writeAllTo(fd, &self, 1);
+    }
+private:
+    static bool writevInternal(int fd, iovec* iov, int count) {
+        while (count > 0) {
+            ssize_t written = ::writev(fd, iov, count);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            while (count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+                written -= static_cast<ssize_t>(iov->iov_len);
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+                iov->iov_len -= static_cast<size_t>(written);
+            }
+        }
+        return true;
+    }
+#endif
+};
+
+// Deferred binary logging: call sites register their format string once and the hot path
+// only writes { 'R', format id, timestamp, level, argument bytes }. The format strings are
+// written as { 'F', id, signature, format } entries ahead of the records that use them.
+#define BDL_BINARY_MAGIC "BDLB\x01"
+#define BDL_BINARY_RECORD_HEADER 18
+
+class binaryFormatRegistry {
+private:
+    struct entry {
+        std::string format;
+        std::string signature;
+    };
+    inline static std::mutex mtx;
+    inline static std::vector<entry> entries;
+public:
+    static unsigned add(const char* format, std::string signature) {
+        std::lock_guard<std::mutex> lock(mtx);
+        entries.push_back({ format, std::move(signature) });
+        return static_cast<unsigned>(entries.size() - 1);
+    }
+    // Appends the definitions registered since `from`, returns the new count
+    static size_t appendDefinitions(std::string& out, size_t from) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (size_t id = from; id < entries.size(); ++id) {
+            unsigned id32 = static_cast<unsigned>(id);
+            unsigned short signatureLength = static_cast<unsigned short>(entries[id].signature.size());
+            unsigned formatLength = static_cast<unsigned>(entries[id].format.size());
+            out += 'F';
+            out.append(reinterpret_cast<const char*>(&id32), sizeof(id32));
+            out.append(reinterpret_cast<const char*>(&signatureLength), sizeof(signatureLength));
+            out += entries[id].signature;
+            out.append(reinterpret_cast<const char*>(&formatLength), sizeof(formatLength));
+            out += entries[id].format;
+        }
+        return entries.size();
+    }
+};
+
+// Type codes: b bool, c char, i signed, u unsigned, d floating point, s string, p pointer
+template <class T>
+constexpr char binaryTypeCode() {
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, bool>) {
+        return 'b';
+    }
+    else if constexpr (std::is_same_v<U, char>) {
+        return 'c';
+    }
+    else if constexpr (std::is_integral_v<U> || std::is_enum_v<U>) {
+        return std::is_signed_v<U> || std::is_enum_v<U> ? 'i' : 'u';
+    }
+    else if constexpr (std::is_floating_point_v<U>) {
+        return 'd';
+    }
+    else if constexpr (std::is_convertible_v<const U&, std::string_view>) {
+        return 's';
+    }
+    else {
+        static_assert(std::is_pointer_v<U>, "BDL: unsupported binary log argument type");
+        return 'p';
+    }
+}
+template <class T>
+size_t binaryArgSize(const T& value) {
+    constexpr char code = binaryTypeCode<T>();
+    if constexpr (code == 'b' || code == 'c') {
+        return 1;
+    }
+    else if constexpr (code == 's') {
+        return sizeof(unsigned short) + std::min<size_t>(std::string_view(value).size(), 0xFFFF);
+    }
+    else {
+        return 8;
+    }
+}
+template <class T>
+char* encodeBinaryArg(char* out, const T& value) {
+    constexpr char code = binaryTypeCode<T>();
+    if constexpr (code == 'b' || code == 'c') {
+        *out = static_cast<char>(value);
+        return out + 1;
+    }
+    else if constexpr (code == 's') {
+        std::string_view view(value);
+        unsigned short length = static_cast<unsigned short>(std::min<size_t>(view.size(), 0xFFFF));
+        std::memcpy(out, &length, sizeof(length));
+        std::memcpy(out + sizeof(length), view.data(), length);
+        return out + sizeof(length) + length;
+    }
+    else {
+        using W = std::conditional_t<code == 'd', double, std::conditional_t<code == 'i', long long, unsigned long long>>;
+        W wide;
+        if constexpr (code == 'p') {
+            wide = reinterpret_cast<unsigned long long>(value);
+        }
+        else {
+            wide = static_cast<W>(value);
+        }
+        std::memcpy(out, &wide, sizeof(wide));
+        return out + sizeof(wide);
+    }
+}
+template <class... Args>
+void encodeBinaryRecord(char* out, unsigned formatId, unsigned long long timestamp, severity level, unsigned argBytes, const Args&... args) {
+    *out++ = 'R';
+    std::memcpy(out, &formatId, sizeof(formatId));
+    std::memcpy(out + 4, &timestamp, sizeof(timestamp));
+    out[12] = static_cast<char>(level);
+    std::memcpy(out + 13, &argBytes, sizeof(argBytes));
+    out += BDL_BINARY_RECORD_HEADER - 1;
+    ((out = encodeBinaryArg(out, args)), ...);
+}
+
+// Structured records of log(level, message, kv(key, value)...): { 'S', total length, timestamp,
+// level, thread id, message length, message, field count, fields }, each field is { key length,
+// key, type code, value } with the values encoded like binary record arguments. Nothing is
+// rendered on the calling thread, outputs turn the records into text or JSON lines when flushing.
+#define BDL_STRUCTURED_HEADER 24
+
+enum class structuredFormat {
+    text,   // "message key=value ..." in the logger's line layout
+    json,   // One JSON object per line
+    binary  // The encoded records as they are (sinks only), readable with decodeBinaryLog()
+};
+
+template <class T>
+struct keyValue {
+    std::string_view key;
+    const T& value;
+};
+// One field of a structured record, kv("lat_us", micros)
+template <class T>
+keyValue<T> kv(std::string_view key, const T& value) {
+    return { key, value };
+}
+
+template <class... Fields>
+size_t structuredRecordSize(std::string_view message, const keyValue<Fields>&... fields) {
+    return BDL_STRUCTURED_HEADER + std::min<size_t>(message.size(), 0xFFFF) + 1
+        + ((2 + std::min<size_t>(fields.key.size(), 0xFF) + binaryArgSize(fields.value)) + ... + 0);
+}
+template <class T>
+char* encodeStructuredField(char* out, const keyValue<T>& field) {
+    unsigned char keyLength = static_cast<unsigned char>(std::min<size_t>(field.key.size(), 0xFF));
+    *out++ = static_cast<char>(keyLength);
+    std::memcpy(out, field.key.data(), keyLength);
+    out += keyLength;
+    *out++ = binaryTypeCode<T>();
+    return encodeBinaryArg(out, field.value);
+}
+// Writes one record of `length` bytes (see structuredRecordSize()) to out
+template <class... Fields>
+void encodeStructuredRecord(char* out, size_t length, unsigned long long timestamp, severity level, unsigned long long threadId,
+    std::string_view message, const keyValue<Fields>&... fields) {
+    static_assert(sizeof...(Fields) <= 0xFF, "BDL: too many structured fields");
+    unsigned length32 = static_cast<unsigned>(length);
+    unsigned short messageLength = static_cast<unsigned short>(std::min<size_t>(message.size(), 0xFFFF));
+    out[0] = 'S';
+    std::memcpy(out + 1, &length32, sizeof(length32));
+    std::memcpy(out + 5, &timestamp, sizeof(timestamp));
+    out[13] = static_cast<char>(level);
+    std::memcpy(out + 14, &threadId, sizeof(threadId));
+    std::memcpy(out + 22, &messageLength, sizeof(messageLength));
+    out += BDL_STRUCTURED_HEADER;
+    std::memcpy(out, message.data(), messageLength);
+    out += messageLength;
+    *out++ = static_cast<char>(sizeof...(Fields));
+    ((out = encodeStructuredField(out, fields)), ...);
+}
+
+// Decoded header of a structured record, the fields are read in place by appendStructuredFields()
+struct structuredView {
+    unsigned length;
+    unsigned long long timestamp;
+    severity level;
+    unsigned long long threadId;
+    std::string_view message;
+    unsigned fieldCount;
+    const char* fields;
+
+    explicit structuredView(const char* record) {
+        unsigned short messageLength;
+        std::memcpy(&length, record + 1, sizeof(length));
+        std::memcpy(&timestamp, record + 5, sizeof(timestamp));
+        level = static_cast<severity>(record[13]);
+        std::memcpy(&threadId, record + 14, sizeof(threadId));
+        std::memcpy(&messageLength, record + 22, sizeof(messageLength));
+        message = std::string_view(record + BDL_STRUCTURED_HEADER, messageLength);
+        fieldCount = static_cast<unsigned char>(record[BDL_STRUCTURED_HEADER + messageLength]);
+        fields = record + BDL_STRUCTURED_HEADER + messageLength + 1;
+    }
+};
+
+// True if the structured record at record is whole within the available bytes: its length fits
+// and the message and every key and value stay inside that length. Records read back from a file
+// are checked with this before a structuredView is made of them
+inline bool structuredRecordValid(const char* record, size_t available) {
+    unsigned length;
+    unsigned short messageLength;
+    if (available < BDL_STRUCTURED_HEADER + 1 || record[0] != 'S') {
+        return false;
+    }
+    std::memcpy(&length, record + 1, sizeof(length));
+    std::memcpy(&messageLength, record + 22, sizeof(messageLength));
+    if (length > available || static_cast<size_t>(BDL_STRUCTURED_HEADER) + messageLength + 1 > length) {
+        return false;
+    }
+    size_t offset = BDL_STRUCTURED_HEADER + messageLength;
+    unsigned fieldCount = static_cast<unsigned char>(record[offset++]);
+    for (unsigned i = 0; i < fieldCount; ++i) {
+        if (offset + 1 > length || offset + 1 + static_cast<unsigned char>(record[offset]) + 1 > length) {
+            return false;
+        }
+        offset += 1 + static_cast<unsigned char>(record[offset]); // Key length and key
+        size_t need;
+        switch (record[offset++]) {
+        case 'b': case 'c': need = 1; break;
+        case 'i': case 'u': case 'd': case 'p': need = 8; break;
+        case 's': {
+            unsigned short valueLength;
+            if (offset + sizeof(valueLength) > length) {
+                return false;
+            }
+            std::memcpy(&valueLength, record + offset, sizeof(valueLength));
+            need = sizeof(valueLength) + valueLength;
+            break;
+        }
+        default: return false;
+        }
+        if (need > length - offset) {
+            return false;
+        }
+        offset += need;
+    }
+    return true;
+}
+
+inline void appendJsonString(std::string& out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        switch (c) {
+        case '"': out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                static constexpr char hex[] = "0123456789abcdef";
+                out.append("\\u00");
+                out += hex[static_cast<unsigned char>(c) >> 4];
+                out += hex[c & 0xF];
+            }
+            else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+// Appends the fields as " key=value" (text, strings with spaces or quotes are quoted) or as
+// ,"key":value members (json)
+inline void appendStructuredFields(std::string& out, const structuredView& record, bool json) {
+    const char* field = record.fields;
+    char digits[32];
+    for (unsigned i = 0; i < record.fieldCount; ++i) {
+        std::string_view key(field + 1, static_cast<unsigned char>(*field));
+        field += 1 + key.size();
+        char code = *field++;
+        if (json) {
+            out += ',';
+            appendJsonString(out, key);
+            out += ':';
+        }
+        else {
+            out += ' ';
+            out.append(key);
+            out += '=';
+        }
+        switch (code) {
+        case 'b': out.append(*field ? "true" : "false"); field += 1; break;
+        case 'c':
+            if (json) {
+                appendJsonString(out, std::string_view(field, 1));
+            }
+            else {
+                out += *field;
+            }
+            field += 1;
+            break;
+        case 'i': { long long v; std::memcpy(&v, field, 8); appendValue(out, v); field += 8; break; }
+        case 'u': { unsigned long long v; std::memcpy(&v, field, 8); appendValue(out, v); field += 8; break; }
+        case 'd': {
+            double v;
+            std::memcpy(&v, field, 8);
+            if (json && !std::isfinite(v)) {
+                out.append("null");
+            }
+            else {
+                appendValue(out, v);
+            }
+            field += 8;
+            break;
+        }
+        case 'p': {
+            unsigned long long v;
+            std::memcpy(&v, field, 8);
+            std::string_view hex(digits, static_cast<size_t>(std::to_chars(digits, digits + sizeof(digits), v, 16).ptr - digits));
+            out.append(json ? "\"0x" : "0x");
+            out.append(hex);
+            if (json) {
+                out += '"';
+            }
+            field += 8;
+            break;
+        }
+        case 's': {
+            unsigned short length;
+            std::memcpy(&length, field, sizeof(length));
+            std::string_view value(field + sizeof(length), length);
+            if (json || value.empty() || value.find_first_of(" \"=\n") != std::string_view::npos) {
+                appendJsonString(out, value);
+            }
+            else {
+                out.append(value);
+            }
+            field += sizeof(length) + length;
+            break;
+        }
+        }
+    }
+}
+// Appends {"ts":nanoseconds,"level":"INFO","thread":id,"msg":"...",fields...} and a newline
+inline void appendStructuredJson(std::string& out, const structuredView& record) {
+    out.append("{\"ts\":");
+    appendNumber(out, record.timestamp);
+    out.append(",\"level\":\"");
+    out.append(severityName(record.level));
+    out.append("\",\"thread\":");
+    appendNumber(out, record.threadId);
+    out.append(",\"msg\":");
+    appendJsonString(out, record.message);
+    appendStructuredFields(out, record, true);
+    out.append("}\n");
+}
+
+// Bytes from the current position to the end of a binary log, no limit if the stream cannot
+// seek. Asked once per log: a seek drops the stream's read buffer
+inline unsigned long long binaryLogRemaining(std::istream& in) {
+    std::streampos pos = in.tellg();
+    if (pos == std::streampos(-1)) {
+        return ~0ULL;
+    }
+    in.seekg(0, std::ios::end);
+    std::streampos end = in.tellg();
+    in.seekg(pos);
+    return end > pos ? static_cast<unsigned long long>(end - pos) : 0;
+}
+
+// Turns a binary log back into text, one line per record. Also reads the raw output of a
+// structuredFormat::binary sink, which has no magic and only holds structured records
+inline bool decodeBinaryLog(std::istream& in, std::ostream& out) {
+    unsigned long long left = binaryLogRemaining(in); // Counted down by every read below
+    auto read = [&](char* data, size_t length) {
+        in.read(data, static_cast<std::streamsize>(length));
+        left -= std::min<unsigned long long>(left, static_cast<unsigned long long>(in.gcount()));
+        return static_cast<bool>(in);
+    };
+    auto next = [&] {
+        int c = in.get();
+        left -= c != EOF && left ? 1 : 0;
+        return c;
+    };
+    char magic[sizeof(BDL_BINARY_MAGIC) - 1];
+    if (in.peek() != 'S' && (!read(magic, sizeof(magic)) || std::memcmp(magic, BDL_BINARY_MAGIC, sizeof(magic)) != 0)) {
+        std::cerr << "Error: Not a BDL binary log.\n";
+        return false;
+    }
+    std::unordered_map<unsigned, std::pair<std::string, std::string>> formats; // id -> signature, format
+    std::string args;
+    for (int tag = next(); tag != EOF; tag = next()) {
+        if (tag == 'S') {
+            unsigned length = 0;
+            read(reinterpret_cast<char*>(&length), sizeof(length));
+            if (!in || length < BDL_STRUCTURED_HEADER + 1 || length - 1 - sizeof(length) > left) {
+                std::cerr << "Error: Corrupt binary log record.\n";
+                return false;
+            }
+            args.resize(length);
+            args[0] = 'S';
+            std::memcpy(&args[1], &length, sizeof(length));
+            read(&args[1 + sizeof(length)], length - 1 - sizeof(length));
+            if (!in || !structuredRecordValid(args.data(), args.size())) {
+                std::cerr << "Error: Corrupt binary log record.\n";
+                return false;
+            }
+            structuredView record(args.data());
+            std::time_t seconds = static_cast<std::time_t>(record.timestamp / 1000000000ULL);
+            std::string fields;
+            appendStructuredFields(fields, record, false);
+            out << std::put_time(std::localtime(&seconds), "%Y-%m-%d %H:%M:%S") << '.'
+                << std::setfill('0') << std::setw(9) << record.timestamp % 1000000000ULL
+                << ' ' << severityPrefix(record.level) << ' ' << record.message << fields << '\n';
+            continue;
+        }
+        if (tag == 'F') {
+            unsigned id = 0;
+            unsigned short signatureLength = 0;
+            unsigned formatLength = 0;
+            // Lengths are checked against the rest of the file before anything is allocated
+            read(reinterpret_cast<char*>(&id), sizeof(id));
+            read(reinterpret_cast<char*>(&signatureLength), sizeof(signatureLength));
+            if (!in || signatureLength > left) {
+                std::cerr << "Error: Corrupt binary log record.\n";
+                return false;
+            }
+            std::string signature(signatureLength, '\0');
+            read(&signature[0], signatureLength);
+            read(reinterpret_cast<char*>(&formatLength), sizeof(formatLength));
+            if (!in || formatLength > left) {
+                std::cerr << "Error: Corrupt binary log record.\n";
+                return false;
+            }
+            std::string format(formatLength, '\0');
+            read(&format[0], formatLength);
+            if (!in) {
+                std::cerr << "Error: Corrupt binary log record.\n";
+                return false;
+            }
+            formats[id] = { std::move(signature), std::move(format) };
+        }
+        else if (tag == 'R') {
+            char header[BDL_BINARY_RECORD_HEADER - 1];
+            unsigned id = 0;
+            unsigned long long timestamp = 0;
+            unsigned argBytes = 0;
+            read(header, sizeof(header));
+            std::memcpy(&id, header, sizeof(id));
+            std::memcpy(&timestamp, header + 4, sizeof(timestamp));
+            std::memcpy(&argBytes, header + 13, sizeof(argBytes));
+            if (!in || argBytes > left) {
+                std::cerr << "Error: Corrupt binary log record.\n";
+                return false;
+            }
+            args.resize(argBytes);
+            read(&args[0], argBytes);
+            auto format = formats.find(id);
+            if (!in || format == formats.end()) {
+                std::cerr << "Error: Corrupt binary log record.\n";
+                return false;
+            }
+            std::time_t seconds = static_cast<std::time_t>(timestamp / 1000000000ULL);
+            out << std::put_time(std::localtime(&seconds), "%Y-%m-%d %H:%M:%S") << '.'
+                << std::setfill('0') << std::setw(9) << timestamp % 1000000000ULL
+                << ' ' << severityPrefix(static_cast<severity>(header[12])) << ' ';
+            const std::string& signature = format->second.first;
+            const std::string& text = format->second.second;
+            const char* arg = args.data();
+            size_t next = 0;
+            for (size_t i = 0; i < text.size(); ++i) {
+                if (text[i] != '{' || i + 1 >= text.size() || text[i + 1] != '}' || next >= signature.size()) {
+                    out << text[i];
+                    continue;
+                }
+                // The signature comes from the file too, so no argument may run past the record
+                char code = signature[next++];
+                size_t left = static_cast<size_t>(args.data() + args.size() - arg);
+                size_t need = code == 'b' || code == 'c' ? 1 : code == 's' ? sizeof(unsigned short) : 8;
+                if (code == 's' && left >= need) {
+                    unsigned short length;
+                    std::memcpy(&length, arg, sizeof(length));
+                    need += length;
+                }
+                if (need > left) {
+                    std::cerr << "Error: Corrupt binary log record.\n";
+                    return false;
+                }
+                switch (code) {
+                case 'b': out << (*arg ? "true" : "false"); arg += 1; break;
+                case 'c': out << *arg; arg += 1; break;
+                case 'i': { long long v; std::memcpy(&v, arg, 8); out << v; arg += 8; break; }
+                case 'u': { unsigned long long v; std::memcpy(&v, arg, 8); out << v; arg += 8; break; }
+                case 'd': { double v; std::memcpy(&v, arg, 8); out << v; arg += 8; break; }
+                case 'p': { unsigned long long v; std::memcpy(&v, arg, 8); out << "0x" << std::hex << v << std::dec; arg += 8; break; }
+                case 's': {
+                    unsigned short length;
+                    std::memcpy(&length, arg, sizeof(length));
+                    out.write(arg + sizeof(length), length);
+                    arg += sizeof(length) + length;
+                    break;
+                }
+                }
+                ++i; // Skip the closing brace
+            }
+            out << '\n';
+        }
+        else {
+            std::cerr << "Error: Corrupt binary log record.\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Usage: BDL_LOG_BINARY(logger, BDL::severity::info, "took {} us for {}", micros, name);
+#define BDL_LOG_BINARY(logger, level, format, ...) \
+    do { \
+        if constexpr (BDL::severityCompiledIn(level)) { \
+            if ((logger).shouldLog(level)) { \
+                (logger).logBinary([] { return format; }, level, ##__VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#if BDL_STATS
+// Counters of one producer thread, only that thread writes them so no read-modify-write is needed
+struct threadStats {
+    std::atomic<unsigned long long> messages{ 0 };
+    std::atomic<unsigned long long> bytes{ 0 };
+    std::atomic<unsigned long long> lockWaits{ 0 };
+    std::atomic<unsigned long long> lockWaitNanos{ 0 };
+
+    static void add(std::atomic<unsigned long long>& counter, unsigned long long value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+};
+#endif
+
+// One BDL_SCOPE statement. The per-call-site aggregate is reported by the first logger the
+// statement was used with, or after that logger is destroyed by the next one
+struct scopeSite {
+    const char* name;
+    std::atomic<unsigned long long> count{ 0 };
+    std::atomic<unsigned long long> totalNanos{ 0 };
+    std::atomic<unsigned long long> maxNanos{ 0 };
+    std::atomic<const void*> owner{ nullptr }; // Logger reporting the aggregate
+
+    explicit scopeSite(const char* siteName) : name(siteName) {}
+    void add(unsigned long long nanos) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+        unsigned long long seen = maxNanos.load(std::memory_order_relaxed);
+        while (nanos > seen && !maxNanos.compare_exchange_weak(seen, nanos, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+// Per-thread state of one producer thread for one logger: the staging buffer of the thread
+// buffer mode and the BDL_STATS counters. Shared between the thread and the logger, so lines
+// buffered by a thread that has exited are still collected by the next output
+struct threadStage {
+    // Header in front of every staged line, the timestamp orders lines of different threads
+    struct record {
+        unsigned long long timestamp;
+        unsigned lineLength;
+        unsigned messageOffset;
+        unsigned messageLength;
+        severity level;
+        bool structured; // The line is an encoded structured record
+    };
+    std::mutex mtx; // Only contended while the logger collects the stage
+    std::string records;
+    std::string collected; // Swapped with records by the logger, only touched under its lock
+    size_t collectedOffset = 0;
+    size_t pendingBytes = 0;
+    short pendingRecords = 0;
+    std::atomic<bool> exited = false;
+    // Finished BDL_SCOPE timings waiting for the trace file
+    struct scopeEvent {
+        unsigned long long start;
+        unsigned long long nanos;
+        const scopeSite* site;
+        unsigned depth;
+    };
+    std::vector<scopeEvent> scopes;
+    const unsigned long long threadId = currentThreadId(); // Created on its own thread
+#if BDL_STATS
+    threadStats stats;
+#endif
+};
+
+// Output target attached with loggerConstructor::addSink(). write() gets whole lines that point
+// straight into the logger's buffers and are only valid during the call
+class logSink {
+public:
+    virtual ~logSink() = default;
+    virtual void write(const char* data, size_t length) = 0;
+    virtual void flush() {}
+    // Sinks that keep records in their own format return true. They get writeSpan() instead of
+    // write(): spans of one level, with structured records left encoded. The text lines of a span
+    // were all logged at timestamp (ns since the epoch), 0 for lines the logger did not stamp
+    virtual bool takesSpans() const {
+        return false;
+    }
+    virtual void writeSpan(const char* data, size_t length, severity level, bool structured, unsigned long long timestamp) {
+        (void)level;
+        (void)structured;
+        (void)timestamp;
+        write(data, length);
+    }
+};
+
+// Any std::ostream, e.g. streamSink(std::cerr)
+class streamSink : public logSink {
+private:
+    std::ostream& stream;
+public:
+    explicit streamSink(std::ostream& target) : stream(target) {}
+    void write(const char* data, size_t length) override {
+        stream.write(data, static_cast<std::streamsize>(length));
+    }
+    void flush() override {
+        stream.flush();
+    }
+};
+
+// Appends to a file, independent of the logger's own file output
+class fileSink : public logSink {
+private:
+#ifdef BDL_POSIX
+    int fd = -1;
+#else
+    std::ofstream file;
+#endif
+public:
+    explicit fileSink(const std::string& path) {
+#ifdef BDL_POSIX
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            std::cerr << "Error: Could not open " << path << " for the file sink.\n";
+        }
+#else
+        file.open(path, std::ios::binary | std::ios::app);
+        if (!file) {
+            std::cerr << "Error: Could not open " << path << " for the file sink.\n";
+        }
+#endif
+    }
+    ~fileSink() override {
+#ifdef BDL_POSIX
+        if (fd >= 0) {
+            ::close(fd);
+        }
+#endif
+    }
+    fileSink(const fileSink&) = delete;
+    fileSink& operator=(const fileSink&) = delete;
+    void write(const char* data, size_t length) override {
+#ifdef BDL_POSIX
+        while (fd >= 0 && length) {
+            ssize_t written = ::write(fd, data, length);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Error: File sink write failed. Disabling the sink.\n";
+                ::close(fd);
+                fd = -1;
+                return;
+            }
+            data += written;
+            length -= static_cast<size_t>(written);
+        }
+#else
+        file.write(data, static_cast<std::streamsize>(length));
+#endif
+    }
+    void flush() override {
+#ifndef BDL_POSIX
+        file.flush();
+#endif
+    }
+};
+
+// Keeps the most recent bytes in memory, e.g. to attach the last log lines to a crash report
+class memorySink : public logSink {
+private:
+    std::mutex mtx;
+    std::string ring;
+    size_t capacity;
+    size_t next = 0;
+    bool wrapped = false;
+public:
+    explicit memorySink(size_t bytes) : ring(bytes, '\0'), capacity(bytes) {}
+    void write(const char* data, size_t length) override {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (capacity == 0) {
+            return;
+        }
+        if (length >= capacity) {
+            data += length - capacity;
+            length = capacity;
+        }
+        size_t first = std::min(length, capacity - next);
+        std::memcpy(&ring[next], data, first);
+        std::memcpy(&ring[0], data + first, length - first);
+        if (next + length >= capacity) {
+            wrapped = true;
+        }
+        next = (next + length) % capacity;
+    }
+    // Oldest first
+    std::string contents() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!wrapped) {
+            return ring.substr(0, next);
+        }
+        return ring.substr(next) + ring.substr(0, next);
+    }
+};
+
+//Bytes of records collected into one block of an indexed log file
+#ifndef BDL_INDEX_BLOCK_SIZE
+#define BDL_INDEX_BLOCK_SIZE (256 * 1024)
+#endif
+
+//Bytes of the word bloom filter in every block footer
+#ifndef BDL_INDEX_BLOOM_BYTES
+#define BDL_INDEX_BLOOM_BYTES 8192
+#endif
+
+// Indexed log files: BDL_INDEX_MAGIC, the bloom filter size (u32), then blocks of
+// { u32 length, records, footer }. A record is an indexRecordHeader and either a text line
+// (without the newline) or an encoded structured record. The footer lets a reader skip a block
+// by time, level or word without looking at its records, see tools/bdl-query.cpp
+#define BDL_INDEX_MAGIC "BDLX\x01"
+
+struct indexRecordHeader {
+    unsigned long long timestamp;
+    unsigned length;
+    severity level;
+    unsigned char structured;
+};
+struct indexBlockFooter {
+    unsigned long long minTimestamp;
+    unsigned long long maxTimestamp;
+    unsigned records;
+    unsigned levels; // Bit n is set when the block holds a record of severity n
+    // Followed by the bloom filter
+};
+
+// Word bloom filter of one block. Words are the runs of letters, digits, '_' and '-'
+class blockIndex {
+public:
+    static bool isWordChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+    }
+    template <class F>
+    static void forEachWord(std::string_view text, F&& f) {
+        size_t start = 0;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            if (i < text.size() && isWordChar(text[i])) {
+                continue;
+            }
+            if (i > start) {
+                f(text.substr(start, i - start));
+            }
+            start = i + 1;
+        }
+    }
+    // Three bits per word from one 64-bit hash (double hashing)
+    static void add(unsigned char* bloom, size_t bytes, std::string_view word) {
+        unsigned long long hash = hashMessage(word);
+        unsigned long long step = (hash >> 32) | 1;
+        for (unsigned i = 0; i < 3; ++i) {
+            unsigned long long bit = (hash + i * step) % (bytes * 8);
+            bloom[bit / 8] |= static_cast<unsigned char>(1u << (bit % 8));
+        }
+    }
+    static bool mayContain(const unsigned char* bloom, size_t bytes, std::string_view word) {
+        unsigned long long hash = hashMessage(word);
+        unsigned long long step = (hash >> 32) | 1;
+        for (unsigned i = 0; i < 3; ++i) {
+            unsigned long long bit = (hash + i * step) % (bytes * 8);
+            if (!(bloom[bit / 8] & (1u << (bit % 8)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Writes an indexed log file (see BDL_INDEX_MAGIC). Records are collected into blocks of
+// BDL_INDEX_BLOCK_SIZE bytes; a block is written when it is full and on every flush(), so the
+// sink's flush interval also bounds how small blocks get. Records keep the time they were logged,
+// text lines the logger did not stamp get the time they reach the sink
+class indexedFileSink : public logSink {
+private:
+    fileSink file;
+    std::string block;
+    std::string words; // Text of the structured record being indexed
+    indexBlockFooter footer{};
+    std::vector<unsigned char> bloom;
+
+    void addRecordInternal(unsigned long long timestamp, severity level, bool structured, std::string_view payload, std::string_view text) {
+        if (block.size() > sizeof(unsigned) && block.size() + sizeof(indexRecordHeader) + payload.size() > BDL_INDEX_BLOCK_SIZE) {
+            writeBlockInternal();
+        }
+        indexRecordHeader header;
+        std::memset(&header, 0, sizeof(header)); // Padding included, it goes to the file as is
+        header.timestamp = timestamp;
+        header.length = static_cast<unsigned>(payload.size());
+        header.level = level;
+        header.structured = static_cast<unsigned char>(structured);
+        block.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        block.append(payload);
+        if (!footer.records || timestamp < footer.minTimestamp) {
+            footer.minTimestamp = timestamp;
+        }
+        footer.maxTimestamp = std::max(footer.maxTimestamp, timestamp);
+        footer.levels |= 1u << static_cast<unsigned>(level);
+        ++footer.records;
+        blockIndex::forEachWord(text, [this](std::string_view word) {
+            blockIndex::add(bloom.data(), bloom.size(), word);
+        });
+    }
+    void writeBlockInternal() {
+        if (!footer.records) {
+            return;
+        }
+        block.append(reinterpret_cast<const char*>(&footer), sizeof(footer));
+        block.append(reinterpret_cast<const char*>(bloom.data()), bloom.size());
+        unsigned length = static_cast<unsigned>(block.size() - sizeof(length));
+        std::memcpy(&block[0], &length, sizeof(length));
+        file.write(block.data(), block.size());
+        block.assign(sizeof(unsigned), '\0'); // Room for the next length
+        footer = indexBlockFooter{};
+        std::fill(bloom.begin(), bloom.end(), 0);
+    }
+public:
+    // New files start with the header, an existing file is appended to
+    explicit indexedFileSink(const std::string& path) : file(path), bloom(BDL_INDEX_BLOOM_BYTES, 0) {
+        std::ifstream existing(path, std::ios::binary | std::ios::ate);
+        if (existing && existing.tellg() == 0) {
+            unsigned bloomBytes = BDL_INDEX_BLOOM_BYTES;
+            file.write(BDL_INDEX_MAGIC, sizeof(BDL_INDEX_MAGIC) - 1);
+            file.write(reinterpret_cast<const char*>(&bloomBytes), sizeof(bloomBytes));
+        }
+        block.reserve(BDL_INDEX_BLOCK_SIZE + sizeof(indexBlockFooter) + BDL_INDEX_BLOOM_BYTES);
+        block.assign(sizeof(unsigned), '\0');
+    }
+    ~indexedFileSink() override {
+        writeBlockInternal();
+    }
+    bool takesSpans() const override {
+        return true;
+    }
+    void write(const char* data, size_t length) override {
+        writeSpan(data, length, severity::info, false, 0);
+    }
+    void writeSpan(const char* data, size_t length, severity level, bool structured, unsigned long long timestamp) override {
+        if (structured) {
+            for (const char* record = data; record < data + length;) {
+                structuredView view(record);
+                words.assign(view.message);
+                appendStructuredFields(words, view, false);
+                addRecordInternal(view.timestamp, view.level, true, std::string_view(record, view.length), words);
+                record += view.length;
+            }
+            return;
+        }
+        if (!timestamp) {
+            timestamp = timestampClock::now(clockSource::system);
+        }
+        for (const char* end = data + length; data < end;) {
+            const char* newline = static_cast<const char*>(std::memchr(data, '\n', static_cast<size_t>(end - data)));
+            std::string_view line(data, static_cast<size_t>((newline ? newline : end) - data));
+            addRecordInternal(timestamp, level, false, line, line);
+            data += line.size() + 1;
+        }
+    }
+    void flush() override {
+        writeBlockInternal();
+        file.flush();
+    }
+};
+
+// What a producer does when the buffered text reaches setBufferLimit()
+enum class overflowPolicy {
+    block,          // Waits for output to free space, dropped after the timeout
+    dropNewest,     // Drops the new message
+    overwriteOldest // Drops the oldest buffered lines
+};
+
+struct dropCounters {
+    unsigned long long droppedNewest;
+    unsigned long long blockTimeouts;
+    unsigned long long overwrittenOldest;
+};
+
+//Async file writer: number and size in bytes of the buffers a write is copied into
+#ifndef BDL_WRITER_BUFFERS
+#define BDL_WRITER_BUFFERS 8
+#endif
+#ifndef BDL_WRITER_BUFFER_SIZE
+#define BDL_WRITER_BUFFER_SIZE (256 * 1024)
+#endif
+
+#ifdef BDL_HAS_IO_URING
+// One io_uring instance set up with the raw system calls. Writes are submitted by one thread at
+// a time (the caller's lock), completions are reaped by another
+class uringQueue {
+private:
+    int ringFd = -1;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    int enterInternal(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+    }
+public:
+    uringQueue() = default;
+    uringQueue(const uringQueue&) = delete;
+    uringQueue& operator=(const uringQueue&) = delete;
+    ~uringQueue() {
+        close();
+    }
+    // False where the kernel has no io_uring or it is not permitted (seccomp, sysctl)
+    bool open(unsigned depth) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &params));
+        if (ringFd < 0) {
+            return false;
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            close();
+            return false;
+        }
+        if (single) {
+            cqRing = sqRing;
+        }
+        else {
+            cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                close();
+                return false;
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMap = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqeMap == MAP_FAILED) {
+            close();
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqeMap);
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+    void close() {
+        if (sqes) {
+            ::munmap(sqes, sqesSize);
+            sqes = nullptr;
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            ::munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != MAP_FAILED) {
+            ::munmap(sqRing, sqRingSize);
+        }
+        sqRing = cqRing = MAP_FAILED;
+        if (ringFd >= 0) {
+            ::close(ringFd);
+            ringFd = -1;
+        }
+    }
+    // Fixed file 0 and fixed buffers 0..count-1 for IORING_OP_WRITE_FIXED
+    bool registerTargets(int fd, const iovec* buffers, unsigned count) {
+        return ::syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_FILES, &fd, 1) == 0 &&
+               ::syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+    }
+    // Submits one write of registered buffer index from data (inside it) at offset of fixed file 0,
+    // or a no-op with length 0. Does not wait for the write
+    bool submit(unsigned index, const char* data, unsigned length, unsigned long long offset, unsigned long long tag) {
+        unsigned tail = *sqTail;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            return false;
+        }
+        unsigned slot = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[slot];
+        std::memset(sqe, 0, sizeof(*sqe));
+        if (length) {
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->fd = 0;
+            sqe->addr = reinterpret_cast<unsigned long long>(data);
+            sqe->len = length;
+            sqe->off = offset;
+            sqe->buf_index = static_cast<unsigned short>(index);
+        }
+        else {
+            sqe->opcode = IORING_OP_NOP;
+        }
+        sqe->user_data = tag;
+        sqArray[slot] = slot;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        while (enterInternal(1, 0, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Blocks until a completion arrives
+    bool wait(unsigned long long& tag, int& result) {
+        while (true) {
+            unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = cqes[head & *cqMask];
+                tag = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (enterInternal(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+    }
+};
+#endif
+
+#ifdef BDL_POSIX
+// fdatasync where there is one, fsync elsewhere
+inline bool syncFileData(int fd) {
+#ifdef __linux__
+    return ::fdatasync(fd) == 0;
+#else
+    return ::fsync(fd) == 0;
+#endif
+}
+
+// Writes a file in the background: write() copies the batches into a fixed pool of buffers and
+// returns once they are queued, the disk I/O runs on io_uring (registered buffers, fixed file)
+// or, where that is unavailable, on a pwrite thread. Only blocks when every buffer is in flight.
+// Each buffer gets an explicit file offset, so the file must not be appended to by anyone else
+class fileWriter {
+private:
+    struct buffer {
+        char* data;
+        size_t length;
+        size_t written;
+        unsigned long long offset;
+        unsigned long long sequence; // 0 while free
+    };
+    int fd;
+    std::unique_ptr<char[]> memory;
+    buffer buffers[BDL_WRITER_BUFFERS];
+    std::vector<unsigned> freeBuffers;
+    std::mutex mtx;
+    std::condition_variable changed; // A buffer completed or an fdatasync finished
+    unsigned long long nextOffset = 0;
+    unsigned long long nextSequence = 1;
+    unsigned long long syncedSequence = 0; // Everything up to here is on disk
+    bool syncing = false;
+    std::atomic<bool> failed = false;
+    bool stopping = false;
+    std::thread worker;
+#ifdef BDL_HAS_IO_URING
+    uringQueue uring;
+    bool useUring = false;
+    static constexpr unsigned long long stopTag = ~0ULL;
+#endif
+    std::vector<unsigned> queued; // pwrite thread only
+
+    // Lowest sequence still in flight, nextSequence if none (assumes lock is held)
+    unsigned long long oldestInFlightInternal() const {
+        unsigned long long oldest = nextSequence;
+        for (const buffer& b : buffers) {
+            if (b.sequence && b.sequence < oldest) {
+                oldest = b.sequence;
+            }
+        }
+        return oldest;
+    }
+    void releaseInternal(unsigned index) {
+        buffers[index].sequence = 0;
+        freeBuffers.push_back(index);
+        changed.notify_all();
+    }
+    // Hands a filled buffer to the I/O side (assumes lock is held)
+    void submitInternal(unsigned index) {
+        buffer& b = buffers[index];
+        b.written = 0;
+        b.offset = nextOffset;
+        b.sequence = nextSequence++;
+        nextOffset += b.length;
+#ifdef BDL_HAS_IO_URING
+        if (useUring) {
+            if (!uring.submit(index, b.data, static_cast<unsigned>(b.length), b.offset, index)) {
+                failed = true;
+                releaseInternal(index);
+            }
+            return;
+        }
+#endif
+        queued.push_back(index);
+        changed.notify_all();
+    }
+#ifdef BDL_HAS_IO_URING
+    void reapLoop() {
+        unsigned long long tag;
+        int result;
+        while (uring.wait(tag, result)) {
+            if (tag == stopTag) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            unsigned index = static_cast<unsigned>(tag);
+            buffer& b = buffers[index];
+            if (result == -EINTR || result == -EAGAIN) {
+                result = 0;
+            }
+            else if (result <= 0) {
+                failed = true;
+                releaseInternal(index);
+                continue;
+            }
+            b.written += static_cast<size_t>(result);
+            if (b.written == b.length) {
+                releaseInternal(index);
+            }
+            else if (!uring.submit(index, b.data + b.written, static_cast<unsigned>(b.length - b.written), b.offset + b.written, index)) {
+                failed = true; // Short write and the rest could not be queued again
+                releaseInternal(index);
+            }
+        }
+        // The ring broke: nothing completes any more, so nobody may wait for it
+        std::lock_guard<std::mutex> lock(mtx);
+        failed = true;
+        for (unsigned i = 0; i < BDL_WRITER_BUFFERS; ++i) {
+            if (buffers[i].sequence) {
+                releaseInternal(i);
+            }
+        }
+    }
+#endif
+    void pwriteLoop() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            changed.wait(lock, [this] { return stopping || !queued.empty(); });
+            if (queued.empty()) {
+                return;
+            }
+            unsigned index = queued.front();
+            queued.erase(queued.begin());
+            buffer& b = buffers[index];
+            lock.unlock();
+            bool ok = true;
+            while (b.written < b.length) {
+                ssize_t result = ::pwrite(fd, b.data + b.written, b.length - b.written, static_cast<off_t>(b.offset + b.written));
+                if (result < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (result <= 0) {
+                    ok = false;
+                    break;
+                }
+                b.written += static_cast<size_t>(result);
+            }
+            lock.lock();
+            if (!ok) {
+                failed = true;
+            }
+            releaseInternal(index);
+        }
+    }
+public:
+    // fd must be open for writing. It is written from its current end
+    explicit fileWriter(int fileFd) : fd(fileFd), memory(new char[static_cast<size_t>(BDL_WRITER_BUFFERS) * BDL_WRITER_BUFFER_SIZE]) {
+        off_t end = ::lseek(fd, 0, SEEK_END);
+        nextOffset = end > 0 ? static_cast<unsigned long long>(end) : 0;
+        for (unsigned i = 0; i < BDL_WRITER_BUFFERS; ++i) {
+            buffers[i] = { memory.get() + static_cast<size_t>(i) * BDL_WRITER_BUFFER_SIZE, 0, 0, 0, 0 };
+            freeBuffers.push_back(BDL_WRITER_BUFFERS - 1 - i);
+        }
+#ifdef BDL_HAS_IO_URING
+        iovec registered[BDL_WRITER_BUFFERS];
+        for (unsigned i = 0; i < BDL_WRITER_BUFFERS; ++i) {
+            registered[i].iov_base = buffers[i].data;
+            registered[i].iov_len = BDL_WRITER_BUFFER_SIZE;
+        }
+        useUring = uring.open(BDL_WRITER_BUFFERS * 2) && uring.registerTargets(fd, registered, BDL_WRITER_BUFFERS);
+        if (useUring) {
+            worker = std::thread(&fileWriter::reapLoop, this);
+            return;
+        }
+        uring.close();
+#endif
+        worker = std::thread(&fileWriter::pwriteLoop, this);
+    }
+    fileWriter(const fileWriter&) = delete;
+    fileWriter& operator=(const fileWriter&) = delete;
+    // Waits for the writes in flight, does not sync them
+    ~fileWriter() {
+        std::unique_lock<std::mutex> lock(mtx);
+        changed.wait(lock, [this] { return freeBuffers.size() == BDL_WRITER_BUFFERS; });
+        stopping = true;
+#ifdef BDL_HAS_IO_URING
+        if (useUring) {
+            uring.submit(0, nullptr, 0, 0, stopTag); // Wakes the reaper, nothing else is in flight now
+        }
+#endif
+        changed.notify_all();
+        lock.unlock();
+        worker.join();
+    }
+    bool usesUring() const {
+#ifdef BDL_HAS_IO_URING
+        return useUring;
+#else
+        return false;
+#endif
+    }
+    // Copies the batches and queues them in order. False once any earlier write has failed
+    bool write(const chunkBuffer* const* batches, size_t count) {
+        std::unique_lock<std::mutex> lock(mtx);
+        int filling = -1;
+        for (size_t i = 0; i < count; ++i) {
+            batches[i]->forEachChunk([&](const char* data, size_t length) {
+                while (length) {
+                    if (filling < 0) {
+                        changed.wait(lock, [this] { return !freeBuffers.empty(); });
+                        filling = static_cast<int>(freeBuffers.back());
+                        freeBuffers.pop_back();
+                        buffers[filling].length = 0;
+                    }
+                    buffer& b = buffers[filling];
+                    size_t part = std::min(length, static_cast<size_t>(BDL_WRITER_BUFFER_SIZE) - b.length);
+                    std::memcpy(b.data + b.length, data, part);
+                    b.length += part;
+                    data += part;
+                    length -= part;
+                    if (b.length == BDL_WRITER_BUFFER_SIZE) {
+                        submitInternal(static_cast<unsigned>(filling));
+                        filling = -1;
+                    }
+                }
+            });
+        }
+        if (filling >= 0) {
+            submitInternal(static_cast<unsigned>(filling));
+        }
+        return !failed;
+    }
+    // Waits until everything written so far is on disk. One fdatasync covers every caller whose
+    // writes had completed when it started, callers arriving meanwhile wait for it and reuse it
+    bool sync() {
+        std::unique_lock<std::mutex> lock(mtx);
+        unsigned long long target = nextSequence - 1;
+        changed.wait(lock, [&] { return oldestInFlightInternal() > target; });
+        while (syncedSequence < target) {
+            if (syncing) {
+                changed.wait(lock);
+                continue;
+            }
+            syncing = true;
+            unsigned long long covered = oldestInFlightInternal() - 1;
+            lock.unlock();
+            bool ok = syncFileData(fd);
+            lock.lock();
+            syncing = false;
+            if (ok) {
+                syncedSequence = std::max(syncedSequence, covered);
+            }
+            else {
+                failed = true;
+            }
+            changed.notify_all();
+            if (!ok) {
+                break;
+            }
+        }
+        return !failed;
+    }
+};
+#endif
+
+// Process-wide output backend. Every logger gets its file handle here: one handle per distinct
+// path, shared by all loggers writing to that path and closed with the last of them. Loggers set
+// to setSharedBackend(true) are also flushed by one I/O thread instead of a flusher each, and the
+// batches of all of them that go to the same file (or to the console) are written together
+class sharedBackend {
+public:
+    struct fileHandle {
+#ifdef BDL_POSIX
+        int fd = -1;
+#else
+        std::ofstream stream;
+#endif
+        std::mutex mtx; // Keeps the batches of different loggers whole
+        std::atomic<bool> failed = false;
+#ifdef BDL_POSIX
+        std::unique_ptr<fileWriter> writer; // Set once by startWriter(), then every write goes through it
+#endif
+
+        ~fileHandle() {
+#ifdef BDL_POSIX
+            writer.reset(); // Waits for its writes
+            if (fd >= 0) {
+                ::close(fd);
+            }
+#endif
+        }
+        // Moves the writes of every logger using this file off their threads (see fileWriter)
+        void startWriter() {
+#ifdef BDL_POSIX
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!writer) {
+                int flags = ::fcntl(fd, F_GETFL);
+                if (flags >= 0) {
+                    ::fcntl(fd, F_SETFL, flags & ~O_APPEND); // The writer places every buffer itself
+                }
+                writer = std::make_unique<fileWriter>(fd);
+            }
+#endif
+        }
+        // Waits until everything written to this file is on disk
+        bool sync() {
+#ifdef BDL_POSIX
+            fileWriter* background;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                background = writer.get();
+            }
+            bool synced = background ? background->sync() : syncFileData(fd);
+#else
+            std::lock_guard<std::mutex> lock(mtx);
+            stream.flush();
+            bool synced = static_cast<bool>(stream);
+#endif
+            if (!synced) {
+                failed = true;
+            }
+            return synced;
+        }
+        bool write(const chunkBuffer* const* batches, size_t count) {
+            std::lock_guard<std::mutex> lock(mtx);
+#ifdef BDL_POSIX
+            bool written = writer ? writer->write(batches, count) : chunkBuffer::writeAllTo(fd, batches, count);
+#else
+            for (size_t i = 0; i < count; ++i) {
+                batches[i]->forEachChunk([this](const char* chunk, size_t length) {
+                    stream.write(chunk, static_cast<std::streamsize>(length));
+                });
+            }
+            bool written = static_cast<bool>(stream);
+#endif
+            if (!written) {
+                failed = true;
+            }
+            return written;
+        }
+    };
+#ifdef BDL_POSIX
+    // A memory-mapped file, shared by every logger writing the same path in mapped mode
+    struct mappedHandle {
+        mappedFileSink sink;
+        std::mutex mtx; // Keeps the batches of different loggers whole
+
+        bool write(const chunkBuffer& data) {
+            std::lock_guard<std::mutex> lock(mtx);
+            bool written = true;
+            data.forEachChunk([&](const char* chunk, size_t length) {
+                written = written && sink.write(chunk, length);
+            });
+            return written;
+        }
+        bool sync() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return sink.sync();
+        }
+    };
+#endif
+    // A logger flushed by the I/O thread
+    class client {
+    public:
+        virtual ~client() = default;
+        // Takes what the logger buffered. Returns the text for the console and file output, or
+        // nullptr if there is none; file stays nullptr unless it goes to a plain file
+        virtual const chunkBuffer* collectBatch(fileHandle*& file, bool& console) = 0;
+        // Everything after the console and file writes: sinks, binary output, counters
+        virtual void finishBatch() = 0;
+    };
 private:
+    struct pendingWrite {
+        fileHandle* file;
+        bool console;
+        const chunkBuffer* data;
+    };
+    std::mutex filesMtx;
+    std::unordered_map<std::string, std::weak_ptr<fileHandle>> files;
+#ifdef BDL_POSIX
+    std::unordered_map<std::string, std::weak_ptr<mappedHandle>> mappedFiles; // Also under filesMtx
+#endif
+    std::mutex attachMtx; // Serializes starting and stopping the I/O thread
+    std::mutex clientsMtx; // Held for a whole flush, a detached client is never touched again
+    std::vector<client*> clients;
+    std::vector<pendingWrite> pending;
+    std::vector<const chunkBuffer*> group;
+    std::thread worker;
+    std::mutex wakeMtx;
+    std::condition_variable wakeCv;
+    std::condition_variable doneCv;
+    std::atomic<bool> wakeRequested = false;
+    bool stopWorker = false;
+    unsigned long long requested = 0;
+    unsigned long long completed = 0;
+    std::chrono::milliseconds latency{ 50 };
+
+    sharedBackend() = default;
+    static void writeConsoleInternal(const chunkBuffer* const* batches, size_t count) {
+#ifdef BDL_POSIX
+        chunkBuffer::writeAllTo(STDERR_FILENO, batches, count);
+#else
+        for (size_t i = 0; i < count; ++i) {
+            batches[i]->forEachChunk([](const char* chunk, size_t length) {
+                std::cerr.write(chunk, static_cast<std::streamsize>(length));
+            });
+        }
+#endif
+    }
+    // One flush of every client: collect all, one write per target, then finish all
+    void flushClientsInternal() {
+        std::lock_guard<std::mutex> lock(clientsMtx);
+        pending.clear();
+        for (client* c : clients) {
+            pendingWrite write{ nullptr, false, nullptr };
+            write.data = c->collectBatch(write.file, write.console);
+            if (write.data) {
+                pending.push_back(write);
+            }
+        }
+        group.clear();
+        for (const pendingWrite& write : pending) {
+            if (write.console) {
+                group.push_back(write.data);
+            }
+        }
+        if (!group.empty()) {
+            writeConsoleInternal(group.data(), group.size());
+        }
+        for (size_t i = 0; i < pending.size(); ++i) {
+            fileHandle* file = pending[i].file;
+            if (!file) {
+                continue;
+            }
+            group.clear();
+            for (size_t j = i; j < pending.size(); ++j) {
+                if (pending[j].file == file) {
+                    group.push_back(pending[j].data);
+                    pending[j].file = nullptr;
+                }
+            }
+            file->write(group.data(), group.size());
+        }
+        for (client* c : clients) {
+            c->finishBatch();
+        }
+    }
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(wakeMtx);
+        while (!stopWorker) {
+            // Wakes on a client's byte threshold, an explicit flush() or the latency deadline
+            wakeCv.wait_for(lock, latency, [this] {
+                return stopWorker || requested != completed || wakeRequested.load(std::memory_order_relaxed);
+            });
+            unsigned long long serving = requested;
+            wakeRequested = false;
+            lock.unlock();
+            flushClientsInternal();
+            lock.lock();
+            completed = serving;
+            doneCv.notify_all();
+        }
+    }
+public:
+    sharedBackend(const sharedBackend&) = delete;
+    sharedBackend& operator=(const sharedBackend&) = delete;
+    // Never destroyed, so loggers with static storage can still detach at exit
+    static sharedBackend& instance() {
+        static sharedBackend* backend = new sharedBackend;
+        return *backend;
+    }
+    // Opens path for appending, or returns the handle another logger already has for it.
+    // nullptr if it cannot be opened or another logger maps it: appended lines would land
+    // behind the preallocated segment and be cut off when that is truncated
+    std::shared_ptr<fileHandle> openFile(const std::string& path) {
+        std::lock_guard<std::mutex> lock(filesMtx);
+        std::weak_ptr<fileHandle>& slot = files[path];
+        if (std::shared_ptr<fileHandle> open = slot.lock()) {
+            return open;
+        }
+#ifdef BDL_POSIX
+        auto mapped = mappedFiles.find(path);
+        if (mapped != mappedFiles.end() && !mapped->second.expired()) {
+            return nullptr;
+        }
+#endif
+        std::shared_ptr<fileHandle> handle = std::make_shared<fileHandle>();
+#ifdef BDL_POSIX
+        handle->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (handle->fd < 0) {
+            return nullptr;
+        }
+#else
+        handle->stream.open(path, std::ios::app);
+        if (!handle->stream) {
+            return nullptr;
+        }
+#endif
+        slot = handle;
+        return handle;
+    }
+#ifdef BDL_POSIX
+    // Maps path, or returns the mapping another logger already has for it, with the segment size
+    // and file count of the logger that mapped it first. nullptr if it cannot be mapped or
+    // another logger appends to it
+    std::shared_ptr<mappedHandle> openMapped(const std::string& path, size_t segmentSize, unsigned maxFiles) {
+        std::lock_guard<std::mutex> lock(filesMtx);
+        std::weak_ptr<mappedHandle>& slot = mappedFiles[path];
+        if (std::shared_ptr<mappedHandle> open = slot.lock()) {
+            return open;
+        }
+        auto appended = files.find(path);
+        if (appended != files.end() && !appended->second.expired()) {
+            return nullptr;
+        }
+        std::shared_ptr<mappedHandle> handle = std::make_shared<mappedHandle>();
+        if (!handle->sink.open(path, segmentSize, maxFiles)) {
+            return nullptr;
+        }
+        slot = handle;
+        return handle;
+    }
+#endif
+    // Number of distinct files open right now
+    size_t openFiles() {
+        std::lock_guard<std::mutex> lock(filesMtx);
+        size_t count = 0;
+        for (auto it = files.begin(); it != files.end();) {
+            if (it->second.expired()) {
+                it = files.erase(it);
+            }
+            else {
+                ++count;
+                ++it;
+            }
+        }
+        return count;
+    }
+    // The I/O thread runs while at least one client is attached. It wakes at least every
+    // flushLatency of the most eager client
+    void attach(client& c, std::chrono::milliseconds flushLatency) {
+        std::lock_guard<std::mutex> attachLock(attachMtx);
+        {
+            std::lock_guard<std::mutex> lock(clientsMtx);
+            clients.push_back(&c);
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMtx);
+            latency = clients.size() == 1 ? flushLatency : std::min(latency, flushLatency);
+            stopWorker = false;
+        }
+        if (!worker.joinable()) {
+            worker = std::thread(&sharedBackend::workerLoop, this);
+        }
+    }
+    // Returns once the I/O thread is done with c
+    void detach(client& c) {
+        std::lock_guard<std::mutex> attachLock(attachMtx);
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(clientsMtx);
+            clients.erase(std::remove(clients.begin(), clients.end(), &c), clients.end());
+            last = clients.empty();
+        }
+        if (last && worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(wakeMtx);
+                stopWorker = true;
+            }
+            wakeCv.notify_one();
+            worker.join();
+        }
+    }
+    // Called by producers, does not wait
+    void wake() {
+        if (!wakeRequested.exchange(true, std::memory_order_relaxed)) {
+            wakeCv.notify_one();
+        }
+    }
+    // Flushes every client and waits for it
+    void flush() {
+        std::unique_lock<std::mutex> lock(wakeMtx);
+        unsigned long long ticket = ++requested;
+        wakeCv.notify_one();
+        doneCv.wait(lock, [&] { return completed >= ticket || stopWorker; });
+    }
+};
+
+// Snapshot returned by loggerConstructor::getStats()
+struct loggerStats {
+    unsigned long long messagesAccepted;
+    unsigned long long loopSuppressed;
+    unsigned long long bytesBuffered;
+    unsigned long long flushes;
+    unsigned long long flushNanos;
+    // flushHistogram[i]: flushes that took less than 2^i microseconds (and at least 2^(i-1)),
+    // the last bucket holds everything slower
+    unsigned long long flushHistogram[BDL_STATS_BUCKETS];
+    unsigned long long lockWaits; // Producer calls that found mtx taken
+    unsigned long long lockWaitNanos;
+    dropCounters drops; // Filled with or without BDL_STATS
+};
+
+// Mutex of a logger only ever used from one thread
+struct nullMutex {
+    void lock() {}
+    bool try_lock() { return true; }
+    void unlock() {}
+};
+
+// Stand-ins for the state of a feature a policy fixes off. Same interface, no storage, and the
+// calls fold away with the flag checks around them
+struct nullRing {
+    void reserve(size_t) {}
+    size_t capacity() const { return 0; }
+    mpscRing::slot* claim() { return nullptr; }
+    void publish(mpscRing::slot*) {}
+    template <class Consumer>
+    size_t drain(Consumer&&, bool = false) { return 0; }
+};
+
+struct nullLoopTable {
+    void reset(size_t) {}
+    void clear() {}
+    template <class Summary>
+    bool seen(std::string_view, Summary&&) { return false; }
+    template <class Summary>
+    void takeRepeats(Summary&&) {}
+};
+
+#ifdef BDL_POSIX
+struct nullFlightRecorder {
+    void reserve(size_t) {}
+    bool isOpen() const { return false; }
+    void setFd(int) {}
+    bool setPath(const std::string&) { return true; }
+    void record(std::string_view) {}
+    void dump() const {}
+    bool registerForCrashes() { return true; }
+    void unregister() {}
+};
+#endif
+
+// Background flusher thread of one logger, only allocated with BDL_C_FLAG_ASYNC_OUTPUT
+struct flusherState {
+    std::thread thread;
     std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable doneCv;
+    bool stop = false;
+    unsigned long long requested = 0;
+    unsigned long long completed = 0;
+};
+
+// Compile time configuration for basicLogger. A policy fixes the configuration flags in mask to
+// the bits of value. A fixed flag is a constant in the logging path, its checks and whatever they
+// guard fold away, and its setter has no effect. Any fixedFlags<mask, value> is a policy too
+namespace policy {
+template <short Mask, short Value, class Mutex = std::mutex>
+struct fixedFlags {
+    static constexpr short mask = Mask;
+    static constexpr short value = Value;
+    using mutex = Mutex;
+};
+// Threading: one thread and no mutex at all, the mutex, the lock-free ring or per-thread buffers
+using singleThread = fixedFlags<BDL_C_FLAG_LOCK_FREE | BDL_C_FLAG_THREAD_BUFFERS | BDL_C_FLAG_ASYNC_OUTPUT | BDL_C_FLAG_SHARED_BACKEND, 0, nullMutex>;
+using mutexProducers = fixedFlags<BDL_C_FLAG_LOCK_FREE | BDL_C_FLAG_THREAD_BUFFERS, 0>;
+using lockFreeProducers = fixedFlags<BDL_C_FLAG_LOCK_FREE | BDL_C_FLAG_THREAD_BUFFERS, BDL_C_FLAG_LOCK_FREE>;
+using threadBufferProducers = fixedFlags<BDL_C_FLAG_LOCK_FREE | BDL_C_FLAG_THREAD_BUFFERS, BDL_C_FLAG_THREAD_BUFFERS>;
+// Dedup
+using loopCheck = fixedFlags<BDL_C_FLAG_LOOP_CHECK, BDL_C_FLAG_LOOP_CHECK>;
+using noLoopCheck = fixedFlags<BDL_C_FLAG_LOOP_CHECK, 0>;
+// Crash dumps: no flight recorder, which also drops its state from the logger
+using noFlightRecorder = fixedFlags<BDL_C_FLAG_FLIGHT_RECORDER, 0>;
+// Flush trigger: every autoOutputInterval messages, only logOutput(), or the flusher thread
+using autoOutput = fixedFlags<BDL_C_FLAG_AUTO_OUTPUT | BDL_C_FLAG_ASYNC_OUTPUT | BDL_C_FLAG_SHARED_BACKEND, BDL_C_FLAG_AUTO_OUTPUT>;
+using manualOutput = fixedFlags<BDL_C_FLAG_AUTO_OUTPUT | BDL_C_FLAG_ASYNC_OUTPUT | BDL_C_FLAG_SHARED_BACKEND, 0>;
+using asyncOutput = fixedFlags<BDL_C_FLAG_ASYNC_OUTPUT, BDL_C_FLAG_ASYNC_OUTPUT>;
+// Sinks: console, file, both, or only the sinks added with addSink()
+using consoleOutput = fixedFlags<BDL_C_FLAG_CONSOLE_OUTPUT | BDL_C_FLAG_FILE_OUTPUT, BDL_C_FLAG_CONSOLE_OUTPUT>;
+using fileOutput = fixedFlags<BDL_C_FLAG_CONSOLE_OUTPUT | BDL_C_FLAG_FILE_OUTPUT, BDL_C_FLAG_FILE_OUTPUT>;
+using consoleAndFileOutput = fixedFlags<BDL_C_FLAG_CONSOLE_OUTPUT | BDL_C_FLAG_FILE_OUTPUT, BDL_C_FLAG_CONSOLE_OUTPUT | BDL_C_FLAG_FILE_OUTPUT>;
+using sinksOnly = fixedFlags<BDL_C_FLAG_CONSOLE_OUTPUT | BDL_C_FLAG_FILE_OUTPUT, 0>;
+} // namespace policy
+
+// The logger. Policies (see BDL::policy) fix parts of the configuration at compile time, e.g.
+// basicLogger<policy::singleThread, policy::noLoopCheck, policy::manualOutput, policy::fileOutput>.
+// Everything no policy fixes is set at runtime, loggerConstructor fixes nothing
+template <class... Policies>
+class basicLogger : private sharedBackend::client {
+private:
+    static constexpr short fixedMask = static_cast<short>((0 | ... | Policies::mask));
+    static constexpr short fixedValue = static_cast<short>((0 | ... | Policies::value));
+    static_assert(((((Policies::value ^ fixedValue) & Policies::mask) == 0) && ...), "Error: Two policies fix the same flag to different values.");
+    using mutexType = std::conditional_t<(std::is_same_v<typename Policies::mutex, nullMutex> || ...), nullMutex, std::mutex>;
+    // False if a policy fixes flag off, then the state of that feature is a null stand-in
+    static constexpr bool mayEnable(short flag) {
+        return !(fixedMask & flag) || (fixedValue & flag);
+    }
+    inline static std::atomic<unsigned long long> nextLoggerId = 1;
+    mutexType mtx;
     std::string fName;
+    std::shared_ptr<sharedBackend::fileHandle> outFile; // Only touched by whoever writes the output
+    bool fileOpenFailed = false; // Same. Open failure already reported while a policy keeps file output on
     std::string logLevel;
-    std::stringstream mainBuffer;
-    std::unordered_set<std::string> loopCheckBuffer;
-    std::atomic<short> configFlags = 27;
+    std::string logLevelName;
+    std::string patternText;
+    linePattern pattern;
+    severity defaultSeverity = severity::info;
+    std::atomic<unsigned char> minSeverity = BDL_LEVEL_TRACE;
+    clockSource timestampSource = clockSource::coarse;
+    unsigned timestampDigits = 3;
+    chunkBuffer mainBuffer;
+    chunkBuffer flushBatch; // Owned by the flusher thread in async mode
+    std::string binaryBatch; // Same
+    chunkBuffer renderedBatch; // Structured records rendered for the console and file output
+    std::string renderedText;
+    structuredFormat structuredOutput = structuredFormat::text;
+    std::conditional_t<mayEnable(BDL_C_FLAG_LOOP_CHECK), loopCheckTable, nullLoopTable> loopCheckBuffer;
+    std::string binaryBuffer;
+    std::string binaryFName;
+    std::unique_ptr<std::ofstream> binaryFile; // Opened by the first binary output
+#ifdef BDL_POSIX
+    std::shared_ptr<sharedBackend::mappedHandle> mappedFile; // Shared with other loggers mapping the same path
+    std::conditional_t<mayEnable(BDL_C_FLAG_FLIGHT_RECORDER), flightRecorder, nullFlightRecorder> flight;
+#endif
+    size_t fileSegmentSize = 64 * 1024 * 1024;
+    unsigned maxFiles = 4;
+    size_t flightRecorderSize = 4 * 1024 * 1024;
+    int crashDumpFd = 2;
+    std::string crashDumpPath;
+    size_t binaryFormatsWritten = 0;
+    std::conditional_t<mayEnable(BDL_C_FLAG_LOCK_FREE), mpscRing, nullRing> ring;
+    std::atomic<short> configFlags = static_cast<short>((27 & ~fixedMask) | fixedValue);
     short looplimit = 1024;
+    size_t ringCapacity = 4096;
     std::atomic<short> autoOutputInterval = 1024;
     std::atomic<short> autoOutputCounter = 0;
-    bool wasInitialized = false;
+    std::atomic<bool> wasInitialized = false;
+    std::mutex outputStartMtx; // Serializes starting the flusher or attaching to the backend
+    std::unique_ptr<flusherState> flusher; // Created when the flusher thread starts, kept until destruction
+    std::atomic<bool> flusherRunning = false;
+    std::atomic<bool> attachedToBackend = false; // Flushed by the shared backend's I/O thread instead of our own
+    // Categories and the optional thread watching their config file
+    categoryTable categories;
+    inline static std::atomic<unsigned> categorySignals = 0; // Bumped by the reload signal handler
+    std::thread categoryWatcher;
+    std::mutex categoryWatchMtx;
+    std::condition_variable categoryWatchCv;
+    bool stopCategoryWatcher = false;
+    std::string categoryConfigPath;
+    std::chrono::milliseconds categoryWatchInterval{ 1000 };
+    // BDL_SCOPE: which of records over the threshold (1), aggregates (2) and the trace file (4) are on
+    std::atomic<unsigned char> scopeMode = 0;
+    std::atomic<unsigned long long> scopeThresholdNanos = 0;
+    severity scopeLevel = severity::info;
+    std::mutex scopeSitesMtx;
+    std::vector<scopeSite*> scopeSites; // Sites aggregated by this logger
+    std::chrono::milliseconds scopeStatsInterval{ 10000 };
+    std::chrono::steady_clock::time_point lastScopeStats = std::chrono::steady_clock::now();
+    std::string scopeRecord; // Aggregate record being encoded, under mtx
+    std::mutex callSitesMtx;
+    std::vector<callSiteLimiter*> callSites; // Sampled statements that suppressed a call for this logger
+    struct traceEvent {
+        threadStage::scopeEvent event;
+        unsigned long long threadId;
+    };
+    std::vector<traceEvent> traceEvents; // Collected from the stages, under mtx
+    std::mutex traceMtx; // traceBatch and the trace file, written by the output outside mtx
+    std::vector<traceEvent> traceBatch; // Being written by the output
+    std::string traceFName;
+    std::unique_ptr<std::ofstream> traceFile; // Opened by the first trace output
+    std::string traceText;
+    unsigned long long traceBase = 0;
+    std::atomic<bool> flushWakeSent = false;
+    std::atomic<bool> durableRequested = false; // The next output syncs the file, see logOutputDurable()
+    std::atomic<size_t> pendingBytes = 0;
+    size_t flushThreshold = 64 * 1024;
+    std::chrono::milliseconds flushLatency{ 50 };
+    int flusherCpu = -1;
+    // Per-thread staging, only used with BDL_C_FLAG_THREAD_BUFFERS
+    const unsigned long long loggerId = nextLoggerId++; // Never reused, unlike the address
+    std::mutex stagesMtx;
+    std::vector<std::shared_ptr<threadStage>> stages;
+    // Sinks attached with addSink(), fed from the same chunks as the console and file output
+    struct sinkEntry {
+        std::shared_ptr<logSink> target;
+        severity minLevel;
+        structuredFormat format;
+        bool takesSpans; // logSink::takesSpans(), asked once
+        std::string rendered; // Structured records of one span, rendered for this sink
+        std::chrono::milliseconds flushInterval;
+        std::chrono::steady_clock::time_point lastFlush;
+        bool dirty = false;
+        // Only used by sinks with their own thread
+        std::thread worker;
+        std::mutex queueMtx;
+        std::condition_variable queueCv;
+        std::vector<std::shared_ptr<chunkBuffer>> queue;
+        bool stop = false;
+    };
+    std::mutex sinksMtx;
+    std::vector<std::unique_ptr<sinkEntry>> sinks;
+    std::atomic<unsigned> stampingSinks = 0; // Sinks taking spans, every text line is stamped while there are any
+    std::mutex batchPoolMtx; // Guards the pool and every release of a batch reference
+    std::vector<std::shared_ptr<chunkBuffer>> batchPool;
+    // Bounded buffering: text accepted but not written yet, only counted while a limit is set
+    std::atomic<size_t> bufferLimit = 0;
+    std::atomic<size_t> bufferedBytes = 0;
+    overflowPolicy overflow = overflowPolicy::block;
+    std::chrono::milliseconds blockTimeout{ 100 };
+    std::mutex spaceMtx;
+    std::condition_variable spaceCv;
+    std::atomic<unsigned long long> dropsSinceMarker = 0;
+    std::atomic<unsigned long long> droppedNewestCount = 0;
+    std::atomic<unsigned long long> blockTimeoutCount = 0;
+    std::atomic<unsigned long long> overwrittenCount = 0;
+    unsigned long long overwrittenSinceOutput = 0;
+    bool overwriteMarkerAtFront = false;
+#if BDL_STATS
+    threadStats retiredStats; // Threads that have exited, summed up with atomic adds
+    std::atomic<unsigned long long> statLoopSuppressed{ 0 };
+    std::atomic<unsigned long long> statFlushes{ 0 };
+    std::atomic<unsigned long long> statFlushNanos{ 0 };
+    std::atomic<unsigned long long> statFlushHistogram[BDL_STATS_BUCKETS] = {};
+    std::chrono::steady_clock::time_point batchStart; // Of the flush batch being written
+#endif
 
+    void repeatSummaryInternal(unsigned repeats, std::string_view preview) {
+        size_t before = mainBuffer.size();
+        mainBuffer.setLevel(defaultSeverity);
+        mainBuffer << logLevel << "Previous message repeated ";
+        if (repeats == 1) {
+            mainBuffer << "once: ";
+        }
+        else {
+            mainBuffer << static_cast<unsigned long long>(repeats) << " times: ";
+        }
+        mainBuffer << preview << '\n';
+        addBufferedInternal(mainBuffer.size() - before);
+    }
+    void addBufferedInternal(size_t bytes) {
+        if (bufferLimit.load(std::memory_order_relaxed)) {
+            bufferedBytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+    void releaseBufferedInternal(size_t bytes) {
+        if (!bufferLimit.load(std::memory_order_relaxed) || !bytes) {
+            return;
+        }
+        size_t current = bufferedBytes.load(std::memory_order_relaxed);
+        while (!bufferedBytes.compare_exchange_weak(current, current > bytes ? current - bytes : 0, std::memory_order_relaxed)) {
+        }
+        if (overflow == overflowPolicy::block) {
+            { std::lock_guard<std::mutex> lock(spaceMtx); } // Pairs with the predicate check of a waiting producer
+            spaceCv.notify_all();
+        }
+    }
+    void wakeFlusherInternal() {
+        if (attachedToBackend) {
+            sharedBackend::instance().wake();
+        }
+        else {
+            flusher->cv.notify_one();
+        }
+    }
+    // Wakes the flusher, or writes inline without one
+    void requestOutputInternal() {
+        if (flusherRunning.load(std::memory_order_relaxed)) {
+            if (!flushWakeSent.exchange(true, std::memory_order_relaxed)) {
+                wakeFlusherInternal();
+            }
+            return;
+        }
+        std::lock_guard<mutexType> lock(mtx);
+        debugOutputInternal();
+    }
+    // Applies the overflow policy, false when the message has to be dropped
+    bool admitInternal(size_t bytes) {
+        size_t limit = bufferLimit.load(std::memory_order_relaxed);
+        if (bufferedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes <= limit) {
+            return true;
+        }
+        if (overflow == overflowPolicy::overwriteOldest) {
+            std::lock_guard<mutexType> lock(mtx);
+            size_t buffered = bufferedBytes.load(std::memory_order_relaxed);
+            if (buffered > limit) {
+                evictOldestInternal(buffered - limit + limit / 8); // Some slack so the next messages fit
+            }
+            return true;
+        }
+        releaseBufferedInternal(bytes);
+        if (overflow == overflowPolicy::dropNewest) {
+            ++droppedNewestCount;
+            ++dropsSinceMarker;
+            return false;
+        }
+        auto deadline = std::chrono::steady_clock::now() + blockTimeout;
+        while (true) {
+            requestOutputInternal();
+            if (bufferedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes <= limit) {
+                return true;
+            }
+            releaseBufferedInternal(bytes);
+            std::unique_lock<std::mutex> lock(spaceMtx);
+            if (!spaceCv.wait_until(lock, deadline, [&] { return bufferedBytes.load(std::memory_order_relaxed) + bytes <= limit; })) {
+                ++blockTimeoutCount;
+                ++dropsSinceMarker;
+                return false;
+            }
+        }
+    }
+    // Written once logging resumes after drops, so the gap is visible in the output
+    void dropMarkerInternal(unsigned long long dropped) {
+        std::lock_guard<mutexType> lock(mtx);
+        drainRingInternal();
+        collectStagesInternal();
+        size_t before = mainBuffer.size();
+        mainBuffer.setLevel(severity::warn);
+        mainBuffer << severityPrefix(severity::warn) << dropped << " messages dropped\n";
+        addBufferedInternal(mainBuffer.size() - before);
+    }
+    // Overwrite-oldest: drops whole lines from the front of mainBuffer and puts a marker with the
+    // count since the last output in their place (assumes lock is held)
+    void evictOldestInternal(size_t bytes) {
+        drainRingInternal();
+        collectStagesInternal();
+        size_t lines = 0;
+        size_t dropped = mainBuffer.dropFront(bytes, lines);
+        if (!dropped) {
+            return; // Everything is already being written
+        }
+        if (overwriteMarkerAtFront && lines) {
+            --lines; // The previous marker went first
+        }
+        overwrittenCount += lines;
+        overwrittenSinceOutput += lines;
+        releaseBufferedInternal(dropped);
+        char marker[64];
+        int length = std::snprintf(marker, sizeof(marker), "%s%llu older messages dropped\n",
+                                   severityPrefix(severity::warn).data(), overwrittenSinceOutput);
+        mainBuffer.prependLine(std::string_view(marker, static_cast<size_t>(length)), severity::warn);
+        addBufferedInternal(static_cast<size_t>(length));
+        overwriteMarkerAtFront = true;
+    }
+    bool loopCheckInternal(std::string_view message) {
+        return loopCheckBuffer.seen(message, [this](unsigned repeats, std::string_view preview) {
+            repeatSummaryInternal(repeats, preview);
+        });
+    }
+    void bufferMessageInternal(std::string_view line, size_t messageOffset, size_t messageLength, severity level, unsigned long long timestamp) {
+        if ((flagsInternal() & BDL_C_FLAG_LOOP_CHECK) && loopCheckInternal(line.substr(messageOffset, messageLength))) {
+            releaseBufferedInternal(line.size());
+#if BDL_STATS
+            statLoopSuppressed.fetch_add(1, std::memory_order_relaxed);
+#endif
+            return;
+        }
+        mainBuffer.setLevel(level, timestamp);
+        mainBuffer << line;
+    }
+    // Emits the "repeated N times" summaries collected since the last output
+    void takeRepeatsInternal() {
+        loopCheckBuffer.takeRepeats([this](unsigned repeats, std::string_view preview) {
+            repeatSummaryInternal(repeats, preview);
+        });
+    }
+    void drainRingInternal(bool waitForClaimed = false) {
+        ring.drain([this](mpscRing::slot& s) {
+            if (s.kind == mpscRing::binaryRecord) {
+                binaryBuffer.append(s.data, s.length);
+                return;
+            }
+            if (s.kind == mpscRing::structuredRecord) {
+                mainBuffer.appendStructured(std::string_view(s.data, s.length), static_cast<severity>(s.level));
+                return;
+            }
+            if ((flagsInternal() & BDL_C_FLAG_LOOP_CHECK) && loopCheckInternal(std::string_view(s.data + s.messageOffset, s.messageLength))) {
+                releaseBufferedInternal(s.length);
+#if BDL_STATS
+                statLoopSuppressed.fetch_add(1, std::memory_order_relaxed);
+#endif
+                return;
+            }
+            mainBuffer.setLevel(static_cast<severity>(s.level), s.timestamp);
+            mainBuffer.append(s.data, s.length);
+        }, waitForClaimed);
+    }
+    // Stage of the calling thread, registered with this logger on its first message
+    threadStage& localStageInternal() {
+        struct entry {
+            unsigned long long owner;
+            std::shared_ptr<threadStage> stage;
+        };
+        struct stageList {
+            std::vector<entry> entries;
+            ~stageList() {
+                for (entry& e : entries) {
+                    e.stage->exited.store(true, std::memory_order_release);
+                }
+            }
+        };
+        thread_local stageList local;
+        for (entry& e : local.entries) {
+            if (e.owner == loggerId) {
+                return *e.stage;
+            }
+        }
+        // Stages only referenced from here belong to loggers that are gone
+        local.entries.erase(std::remove_if(local.entries.begin(), local.entries.end(), [](const entry& e) {
+            return e.stage.use_count() == 1;
+        }), local.entries.end());
+        std::shared_ptr<threadStage> stage = std::make_shared<threadStage>();
+        {
+            std::lock_guard<std::mutex> lock(stagesMtx);
+            stages.push_back(stage);
+        }
+        local.entries.push_back({ loggerId, stage });
+        return *stage;
+    }
+    // Producer side of the thread buffer mode, nothing shared with other producers is written.
+    // Auto output and the flush threshold count per thread here
+    void pushStaged(std::string_view line, size_t messageOffset, size_t messageLength, severity level, bool structured = false,
+                    unsigned long long timestamp = 0) {
+        threadStage& stage = localStageInternal();
+        threadStage::record header{ timestamp ? timestamp : timestampClock::now(timestampSource), static_cast<unsigned>(line.size()),
+            static_cast<unsigned>(messageOffset), static_cast<unsigned>(messageLength), level, structured };
+        short flags = flagsInternal();
+        bool due = false;
+        {
+            std::lock_guard<std::mutex> lock(stage.mtx);
+            stage.records.append(reinterpret_cast<const char*>(&header), sizeof(header));
+            stage.records.append(line);
+            stage.pendingBytes += line.size();
+            if ((flags & BDL_C_FLAG_AUTO_OUTPUT) && ++stage.pendingRecords >= autoOutputInterval) {
+                due = true;
+            }
+            if (flusherRunning.load(std::memory_order_relaxed) && stage.pendingBytes >= flushThreshold) {
+                due = true;
+            }
+            if (due) {
+                stage.pendingBytes = 0;
+                stage.pendingRecords = 0;
+            }
+        }
+        if (!due) {
+            return;
+        }
+        if (flusherRunning.load(std::memory_order_relaxed)) {
+            if (!flushWakeSent.exchange(true, std::memory_order_relaxed)) {
+                wakeFlusherInternal();
+            }
+            return;
+        }
+        std::unique_lock<mutexType> lock(mtx, std::try_to_lock); // Someone else is already draining otherwise
+        if (lock) {
+            debugOutputInternal();
+        }
+    }
+    // Takes every stage and merges the lines into mainBuffer by timestamp (assumes lock is held)
+    void collectStagesInternal() {
+        std::lock_guard<std::mutex> lock(stagesMtx);
+        if (stages.empty()) {
+            return;
+        }
+        for (const std::shared_ptr<threadStage>& stage : stages) {
+            std::lock_guard<std::mutex> stageLock(stage->mtx);
+            stage->collected.clear();
+            stage->collected.swap(stage->records); // Both strings keep their capacity
+            stage->collectedOffset = 0;
+            stage->pendingBytes = 0;
+            stage->pendingRecords = 0;
+            for (const threadStage::scopeEvent& event : stage->scopes) {
+                traceEvents.push_back({ event, stage->threadId });
+            }
+            stage->scopes.clear();
+        }
+        // Every stage is already in time order, a linear pick per line is enough for a few dozen threads
+        while (true) {
+            threadStage* next = nullptr;
+            threadStage::record nextHeader{};
+            for (const std::shared_ptr<threadStage>& stage : stages) {
+                if (stage->collectedOffset >= stage->collected.size()) {
+                    continue;
+                }
+                threadStage::record header;
+                std::memcpy(&header, stage->collected.data() + stage->collectedOffset, sizeof(header));
+                if (!next || header.timestamp < nextHeader.timestamp) {
+                    next = stage.get();
+                    nextHeader = header;
+                }
+            }
+            if (!next) {
+                break;
+            }
+            std::string_view line(next->collected.data() + next->collectedOffset + sizeof(nextHeader), nextHeader.lineLength);
+            next->collectedOffset += sizeof(nextHeader) + nextHeader.lineLength;
+            if (nextHeader.structured) {
+                mainBuffer.appendStructured(line, nextHeader.level);
+            }
+            else {
+                bufferMessageInternal(line, nextHeader.messageOffset, nextHeader.messageLength, nextHeader.level, nextHeader.timestamp);
+            }
+        }
+        // Threads that exited are dropped once everything they buffered has been taken
+        stages.erase(std::remove_if(stages.begin(), stages.end(), [this](const std::shared_ptr<threadStage>& stage) {
+            if (!stage->exited.load(std::memory_order_acquire)) {
+                return false;
+            }
+            std::lock_guard<std::mutex> stageLock(stage->mtx);
+            if (!stage->records.empty() || !stage->scopes.empty()) {
+                return false;
+            }
+#if BDL_STATS
+            retiredStats.messages.fetch_add(stage->stats.messages.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            retiredStats.bytes.fetch_add(stage->stats.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            retiredStats.lockWaits.fetch_add(stage->stats.lockWaits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            retiredStats.lockWaitNanos.fetch_add(stage->stats.lockWaitNanos.load(std::memory_order_relaxed), std::memory_order_relaxed);
+#endif
+            return true;
+        }), stages.end());
+    }
+    // Producer side of the lock-free mode, false if the record has to take the locked path
+    bool pushLockFree(std::string_view line, size_t messageOffset, size_t messageLength, severity level,
+                      unsigned char kind = mpscRing::textRecord, unsigned long long timestamp = 0) {
+        if (line.size() > mpscRing::payloadSize) {
+            return false;
+        }
+        mpscRing::slot* s = ring.claim();
+        if (!s) {
+            return false;
+        }
+        std::memcpy(s->data, line.data(), line.size());
+        s->timestamp = timestamp;
+        s->length = static_cast<unsigned short>(line.size());
+        s->messageOffset = static_cast<unsigned short>(messageOffset);
+        s->messageLength = static_cast<unsigned short>(messageLength);
+        s->kind = kind;
+        s->level = static_cast<unsigned char>(level);
+        ring.publish(s);
+        return true;
+    }
+    // Per-thread line being built; keeps its capacity so steady state formatting does not allocate
+    static std::string& lineScratch() {
+        thread_local std::string line;
+        return line;
+    }
+    // Per-thread message text of logMessage(args...) and logf(), same reuse as lineScratch()
+    static std::string& messageScratch() {
+        thread_local std::string message;
+        return message;
+    }
+    // Per-thread encoded record of log(level, message, kv(...)...)
+    static std::string& recordScratch() {
+        thread_local std::string record;
+        return record;
+    }
+    // Per-thread text of a structured record being rendered, on whichever thread writes the output
+    static std::string& renderScratch() {
+        thread_local std::string text;
+        return text;
+    }
+    // Log time of a text line, only read if the line shows it or a sink keeps it. 0 otherwise
+    unsigned long long lineTimeInternal() const {
+        bool shown = pattern.empty() ? (flagsInternal() & BDL_C_FLAG_TIMESTAMPS) != 0 : pattern.showsTime();
+        return shown || stampingSinks.load(std::memory_order_relaxed) ? timestampClock::now(timestampSource) : 0;
+    }
+    // Renders the full line (pattern, or timestamp + prefix + message) into the scratch line,
+    // returns the message offset
+    size_t formatLineInternal(std::string& line, unsigned long long timestamp, std::string_view levelName, std::string_view prefix,
+                              std::string_view message, std::string_view categoryName) {
+        line.clear();
+        size_t messageOffset;
+        if (!pattern.empty()) {
+            messageOffset = pattern.renderAt(line, timestamp, 0, levelName, message, categoryName);
+        }
+        else {
+            if (flagsInternal() & BDL_C_FLAG_TIMESTAMPS) {
+                char stamp[BDL_TIMESTAMP_MAX];
+                line.append(stamp, timestampCache::local().format(timestamp, timestampDigits, stamp));
+                line += ' ';
+            }
+            line.append(prefix);
+            messageOffset = line.size();
+            line.append(message);
+        }
+        line += '\n';
+        return messageOffset;
+    }
+    // configFlags with the flags fixed by the policies filled in as constants
+    short flagsInternal() const {
+        return static_cast<short>((configFlags.load(std::memory_order_relaxed) & ~fixedMask) | fixedValue);
+    }
+    // Takes mtx on a producer path, with BDL_STATS the time spent waiting for it is counted
+    std::unique_lock<mutexType> lockProducerInternal() {
+#if BDL_STATS
+        std::unique_lock<mutexType> lock(mtx, std::try_to_lock);
+        if (!lock) {
+            auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            threadStats& stats = localStageInternal().stats;
+            threadStats::add(stats.lockWaits, 1);
+            threadStats::add(stats.lockWaitNanos, static_cast<unsigned long long>(waited.count()));
+        }
+        return lock;
+#else
+        return std::unique_lock<mutexType>(mtx);
+#endif
+    }
+#if BDL_STATS
+    void countAcceptedInternal(size_t bytes) {
+        threadStats& stats = localStageInternal().stats;
+        threadStats::add(stats.messages, 1);
+        threadStats::add(stats.bytes, bytes);
+    }
+    void countFlushInternal(std::chrono::steady_clock::time_point start) {
+        unsigned long long nanos = static_cast<unsigned long long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        unsigned bucket = 0;
+        for (unsigned long long micros = nanos / 1000; micros && bucket + 1 < BDL_STATS_BUCKETS; micros >>= 1) {
+            ++bucket;
+        }
+        statFlushes.fetch_add(1, std::memory_order_relaxed);
+        statFlushNanos.fetch_add(nanos, std::memory_order_relaxed);
+        statFlushHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+#endif
+    // Buffer limit and drop marker, then the accepted message counters. False if the message is dropped
+    bool acceptInternal(size_t bytes) {
+        if (bufferLimit.load(std::memory_order_relaxed)) {
+            if (!admitInternal(bytes)) {
+                return false;
+            }
+            if (dropsSinceMarker.load(std::memory_order_relaxed)) {
+                if (unsigned long long dropped = dropsSinceMarker.exchange(0)) {
+                    dropMarkerInternal(dropped);
+                }
+            }
+        }
+#if BDL_STATS
+        countAcceptedInternal(bytes);
+#endif
+        return true;
+    }
+    void logInternal(severity level, std::string_view levelName, std::string_view prefix, std::string_view message,
+                     std::string_view categoryName = {}) {
+        if (!wasInitialized) {
+            initializeOnFirstUseInternal();
+        }
+        std::string& line = lineScratch();
+        unsigned long long timestamp = lineTimeInternal();
+        size_t messageOffset = formatLineInternal(line, timestamp, levelName, prefix, message, categoryName);
+#ifdef BDL_POSIX
+        if ((flagsInternal() & BDL_C_FLAG_FLIGHT_RECORDER) && flight.isOpen()) {
+            flight.record(line);
+#if BDL_STATS
+            countAcceptedInternal(line.size());
+#endif
+            if (level >= severity::fatal) {
+                flight.dump();
+            }
+            return;
+        }
+#endif
+        bufferLineInternal(level, line, messageOffset, message.size(), timestamp);
+        if (level >= severity::fatal && (flagsInternal() & BDL_C_FLAG_DURABLE_FLUSH)) {
+            logOutputDurable();
+        }
+    }
+    void bufferLineInternal(severity level, std::string_view line, size_t messageOffset, size_t messageLength, unsigned long long timestamp) {
+        if (!acceptInternal(line.size())) {
+            return;
+        }
+        if ((flagsInternal() & BDL_C_FLAG_THREAD_BUFFERS) && wasInitialized) {
+            pushStaged(line, messageOffset, messageLength, level, false, timestamp);
+            return;
+        }
+        if ((flagsInternal() & BDL_C_FLAG_LOCK_FREE) && wasInitialized && ring.capacity()
+            && pushLockFree(line, messageOffset, messageLength, level, mpscRing::textRecord, timestamp)) {
+            scheduleOutputInternal(line.size(), false);
+            return;
+        }
+        std::unique_lock<mutexType> lock = lockProducerInternal(); // Lock held for entire function
+        drainRingInternal(true); // Keep ordering with records still waiting in the ring
+        bufferMessageInternal(line, messageOffset, messageLength, level, timestamp);
+        scheduleOutputInternal(line.size(), true);
+    }
+    // Same routing as logInternal() for an encoded structured record. No loop check, every
+    // record carries its own fields
+    void logStructuredInternal(severity level, std::string_view record) {
+        if (!wasInitialized) {
+            initializeOnFirstUseInternal();
+        }
+        if (!acceptInternal(record.size())) {
+            return;
+        }
+        if ((flagsInternal() & BDL_C_FLAG_THREAD_BUFFERS) && wasInitialized) {
+            pushStaged(record, 0, 0, level, true);
+            return;
+        }
+        if ((flagsInternal() & BDL_C_FLAG_LOCK_FREE) && wasInitialized && ring.capacity() && pushLockFree(record, 0, 0, level, mpscRing::structuredRecord)) {
+            scheduleOutputInternal(record.size(), false);
+            return;
+        }
+        std::unique_lock<mutexType> lock = lockProducerInternal();
+        drainRingInternal(true);
+        mainBuffer.appendStructured(record, level);
+        scheduleOutputInternal(record.size(), true);
+    }
+    // Appends one structured record as a line in the given format (not binary)
+    void renderStructuredInternal(std::string& out, const char* record, structuredFormat format) const {
+        structuredView view(record);
+        if (format == structuredFormat::json) {
+            appendStructuredJson(out, view);
+            return;
+        }
+        std::string& message = renderScratch();
+        message.assign(view.message);
+        appendStructuredFields(message, view, false);
+        if (!pattern.empty()) {
+            pattern.renderAt(out, view.timestamp, view.threadId, severityName(view.level), message);
+        }
+        else {
+            if (flagsInternal() & BDL_C_FLAG_TIMESTAMPS) {
+                char stamp[BDL_TIMESTAMP_MAX];
+                out.append(stamp, timestampCache::local().format(view.timestamp, timestampDigits, stamp));
+                out += ' ';
+            }
+            out.append(severityPrefix(view.level));
+            out.append(message);
+        }
+        out += '\n';
+    }
+    // Appends the records of one structured span rendered in format
+    void renderSpanInternal(std::string& out, const char* span, size_t length, structuredFormat format) const {
+        for (const char* record = span; record < span + length;) {
+            unsigned recordLength;
+            std::memcpy(&recordLength, record + 1, sizeof(recordLength));
+            renderStructuredInternal(out, record, format);
+            record += recordLength;
+        }
+    }
+    // Console and file output take text: buffers holding structured records are rendered once
+    // into renderedBatch, buffers with text only are written as they are
+    const chunkBuffer& renderedInternal(const chunkBuffer& data) {
+        if (!data.hasStructured()) {
+            return data;
+        }
+        renderedBatch.clear();
+        data.forEachSpan(severity::trace, [&](const char* span, size_t length, bool structured, severity, unsigned long long) {
+            if (!structured) {
+                renderedBatch.append(span, length);
+                return;
+            }
+            renderedText.clear();
+            renderSpanInternal(renderedText, span, length, structuredOutput);
+            renderedBatch << renderedText;
+        });
+        return renderedBatch;
+    }
+    // Everything of the console and file output but the plain console and file writes: renders
+    // structured records and writes the mapped file. Returns the text to write, or nullptr if
+    // there is none, with the file handle to write it to (nullptr for none)
+    const chunkBuffer* prepareOutputInternal(const chunkBuffer& source, sharedBackend::fileHandle*& file, bool& console) {
+        short flags = flagsInternal();
+        if (source.empty() || !(flags & (BDL_C_FLAG_CONSOLE_OUTPUT | BDL_C_FLAG_FILE_OUTPUT))) {
+            return nullptr;
+        }
+        const chunkBuffer& data = renderedInternal(source);
+        console = (flags & BDL_C_FLAG_CONSOLE_OUTPUT) != 0;
+#ifdef BDL_POSIX
+        if ((flags & BDL_C_FLAG_FILE_OUTPUT) && (flags & BDL_C_FLAG_MAPPED_FILE)) {
+            if (mappedFile && mappedFile->write(data)) {
+                return &data;
+            }
+            std::cerr << "Error: Mapped file write failed. Falling back to stream file output.\n";
+            configFlags.fetch_and(~BDL_C_FLAG_MAPPED_FILE, std::memory_order_relaxed);
+            mappedFile.reset(); // Our mapping would keep the stream file from opening
+        }
+#endif
+        if ((flags & BDL_C_FLAG_FILE_OUTPUT)) {
+            if (!outFile) {
+                outFile = sharedBackend::instance().openFile(fName);
+                if (outFile && (flags & BDL_C_FLAG_ASYNC_FILE)) {
+                    outFile->startWriter();
+                }
+            }
+            if (!outFile && !fileOpenFailed) {
+                std::cerr << "Error: Could not open " << fName << " (or another logger maps it). Disabling file output.\n";
+                configFlags.fetch_and(~BDL_C_FLAG_FILE_OUTPUT, std::memory_order_relaxed);
+            }
+            fileOpenFailed = !outFile && (fixedMask & BDL_C_FLAG_FILE_OUTPUT); // Then it stays on and is retried quietly
+            file = outFile.get();
+        }
+        return &data;
+    }
+    void checkFileInternal() {
+        if (outFile && outFile->failed) {
+            std::cerr << "Error: File write failed. Disabling file output.\n";
+            configFlags.fetch_and(~BDL_C_FLAG_FILE_OUTPUT, std::memory_order_relaxed);
+            outFile.reset();
+        }
+    }
+    // Durable flush: waits until the file output written so far is on disk. Called by whoever
+    // writes the output, after its write
+    void syncOutputInternal() {
+        if (!durableRequested.exchange(false)) {
+            return;
+        }
+#ifdef BDL_POSIX
+        if (mappedFile && !mappedFile->sync()) {
+            std::cerr << "Error: Mapped file sync failed.\n";
+        }
+#endif
+        if (outFile) {
+            outFile->sync();
+            checkFileInternal();
+        }
+    }
+    // Both sinks are served from the same chunks, no copy of the buffered data is made
+    void writeOutputInternal(const chunkBuffer& source) {
+        sharedBackend::fileHandle* file = nullptr;
+        bool console = false;
+        const chunkBuffer* data = prepareOutputInternal(source, file, console);
+        if (!data) {
+            syncOutputInternal(); // Earlier writes may still be in flight
+            return;
+        }
+        if (console) {
+#ifdef BDL_POSIX
+            data->writeTo(STDERR_FILENO);
+#else
+            data->forEachChunk([](const char* chunk, size_t length) {
+                std::cerr.write(chunk, static_cast<std::streamsize>(length));
+            });
+#endif
+        }
+        if (file) {
+            file->write(&data, 1);
+            checkFileInternal();
+        }
+        syncOutputInternal();
+    }
+    void writeBinaryInternal(const std::string& records) {
+        if (records.empty() || !(flagsInternal() & BDL_C_FLAG_BINARY_OUTPUT)) {
+            return;
+        }
+        if (!binaryFile) {
+            binaryFile = std::make_unique<std::ofstream>(binaryFName, std::ios::binary | std::ios::app);
+            if (*binaryFile && binaryFile->tellp() == 0) {
+                binaryFile->write(BDL_BINARY_MAGIC, sizeof(BDL_BINARY_MAGIC) - 1);
+            }
+        }
+        std::string definitions;
+        binaryFormatsWritten = binaryFormatRegistry::appendDefinitions(definitions, binaryFormatsWritten);
+        *binaryFile << definitions;
+        binaryFile->write(records.data(), records.size());
+        binaryFile->flush();
+        if (!*binaryFile) {
+            std::cerr << "Error: Binary file write failed. Disabling binary output.\n";
+            configFlags.fetch_and(~BDL_C_FLAG_BINARY_OUTPUT, std::memory_order_relaxed);
+        }
+    }
+    static void flushSinkInternal(sinkEntry& entry, bool force) {
+        auto now = std::chrono::steady_clock::now();
+        if (entry.dirty && (force || now - entry.lastFlush >= entry.flushInterval)) {
+            entry.target->flush();
+            entry.lastFlush = now;
+            entry.dirty = false;
+        }
+    }
+    // Writes the records at or above the sink's level in the sink's format, flushes when its
+    // interval is up. A binary sink only gets the structured records
+    void deliverInternal(sinkEntry& entry, const chunkBuffer& data) const {
+        if (entry.takesSpans) {
+            data.forEachSpan(entry.minLevel, [&](const char* span, size_t length, bool structured, severity level, unsigned long long timestamp) {
+                entry.target->writeSpan(span, length, level, structured, timestamp);
+                entry.dirty = true;
+            }, true);
+            flushSinkInternal(entry, false);
+            return;
+        }
+        data.forEachSpan(entry.minLevel, [&](const char* span, size_t length, bool structured, severity, unsigned long long) {
+            if (structured && entry.format != structuredFormat::binary) {
+                entry.rendered.clear();
+                renderSpanInternal(entry.rendered, span, length, entry.format);
+                span = entry.rendered.data();
+                length = entry.rendered.size();
+            }
+            else if (!structured && entry.format == structuredFormat::binary) {
+                return;
+            }
+            entry.target->write(span, length);
+            entry.dirty = true;
+        });
+        flushSinkInternal(entry, false);
+    }
+    void sinkLoop(sinkEntry& entry) {
+        std::vector<std::shared_ptr<chunkBuffer>> batches;
+        std::unique_lock<std::mutex> lock(entry.queueMtx);
+        while (true) {
+            auto ready = [&entry] { return entry.stop || !entry.queue.empty(); };
+            if (entry.dirty && entry.flushInterval.count() > 0) {
+                entry.queueCv.wait_for(lock, entry.flushInterval, ready); // Also wakes for a pending flush
+            }
+            else {
+                entry.queueCv.wait(lock, ready);
+            }
+            batches.swap(entry.queue);
+            bool stopping = entry.stop;
+            lock.unlock();
+            for (const std::shared_ptr<chunkBuffer>& batch : batches) {
+                deliverInternal(entry, *batch);
+            }
+            flushSinkInternal(entry, stopping);
+            {
+                std::lock_guard<std::mutex> poolLock(batchPoolMtx);
+                for (std::shared_ptr<chunkBuffer>& batch : batches) {
+                    dropBatchInternal(batch);
+                }
+                batches.clear();
+            }
+            lock.lock();
+            if (stopping && entry.queue.empty()) {
+                break;
+            }
+        }
+    }
+    // A pooled batch no sink thread reads anymore, its old chunks become spares of data
+    std::shared_ptr<chunkBuffer> takeBatchInternal(chunkBuffer& data) {
+        std::lock_guard<std::mutex> lock(batchPoolMtx);
+        for (const std::shared_ptr<chunkBuffer>& batch : batchPool) {
+            if (batch.use_count() == 1) {
+                batch->clear();
+                data.recycleFrom(*batch);
+                return batch;
+            }
+        }
+        batchPool.push_back(std::make_shared<chunkBuffer>());
+        return batchPool.back();
+    }
+    // Drops a reference to a shared batch, its bytes stop counting against the buffer limit
+    // once no sink still has it (assumes batchPoolMtx is held)
+    void dropBatchInternal(std::shared_ptr<chunkBuffer>& batch) {
+        if (batch.use_count() == 2) { // This one and the pool
+            releaseBufferedInternal(batch->size());
+        }
+        batch.reset();
+    }
+    // Inline sinks write straight from data. Sinks with their own thread share one batch by
+    // reference, data is left empty then and true is returned
+    bool fanOutInternal(chunkBuffer& data) {
+        std::lock_guard<std::mutex> lock(sinksMtx);
+        if (sinks.empty() || data.empty()) {
+            return false;
+        }
+        bool threaded = false;
+        for (const std::unique_ptr<sinkEntry>& entry : sinks) {
+            if (entry->worker.joinable()) {
+                threaded = true;
+            }
+            else {
+                deliverInternal(*entry, data);
+            }
+        }
+        if (!threaded) {
+            return false;
+        }
+        std::shared_ptr<chunkBuffer> batch = takeBatchInternal(data);
+        data.moveTo(*batch);
+        for (const std::unique_ptr<sinkEntry>& entry : sinks) {
+            if (entry->worker.joinable()) {
+                {
+                    std::lock_guard<std::mutex> queueLock(entry->queueMtx);
+                    entry->queue.push_back(batch);
+                }
+                entry->queueCv.notify_one();
+            }
+        }
+        std::lock_guard<std::mutex> poolLock(batchPoolMtx);
+        dropBatchInternal(batch);
+        return true;
+    }
+    // Delivers what is queued for the sink and flushes it one last time
+    void stopSinkInternal(sinkEntry& entry) {
+        if (entry.worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(entry.queueMtx);
+                entry.stop = true;
+            }
+            entry.queueCv.notify_one();
+            entry.worker.join();
+        }
+        else {
+            flushSinkInternal(entry, true);
+        }
+    }
     void debugOutputInternal() {
-        if ((configFlags.load(std::memory_order_relaxed) & BDL_C_FLAG_CONSOLE_OUTPUT)) {
-            std::cerr << mainBuffer.str();
+        drainRingInternal();
+        collectStagesInternal();
+        takeRepeatsInternal();
+        emitScopeStatsInternal(false);
+        emitSuppressedInternal(false);
+        size_t bytes = mainBuffer.size();
+        overwrittenSinceOutput = 0;
+        overwriteMarkerAtFront = false;
+#if BDL_STATS
+        auto start = std::chrono::steady_clock::now();
+#endif
+        writeOutputInternal(mainBuffer);
+        if (!fanOutInternal(mainBuffer)) {
+            releaseBufferedInternal(bytes); // Otherwise released by the sinks
+        }
+        writeBinaryInternal(binaryBuffer);
+        takeTraceEventsInternal();
+        writeTraceInternal();
+#if BDL_STATS
+        if (bytes || !binaryBuffer.empty()) {
+            countFlushInternal(start);
+        }
+#endif
+        mainBuffer.clear();
+        binaryBuffer.clear();
+        autoOutputCounter = 0;
+    }
+    // Buffers one "name count=.. total_us=.. avg_us=.. max_us=.." record per site used since the
+    // last report, at most every scopeStatsInterval unless forced (assumes lock is held)
+    void emitScopeStatsInternal(bool force) {
+        if (!(scopeMode.load(std::memory_order_relaxed) & 2)) {
+            return;
         }
-        if ((configFlags.load(std::memory_order_relaxed) & BDL_C_FLAG_FILE_OUTPUT)) {
-            static std::ofstream outFile(fName, std::ios::app);
-            if (outFile) {
-                outFile << mainBuffer.str();
+        auto now = std::chrono::steady_clock::now();
+        if (!force && now - lastScopeStats < scopeStatsInterval) {
+            return;
+        }
+        lastScopeStats = now;
+        std::lock_guard<std::mutex> lock(scopeSitesMtx);
+        for (scopeSite* site : scopeSites) {
+            unsigned long long count = site->count.exchange(0, std::memory_order_relaxed);
+            if (!count) {
+                continue;
             }
-            else {
-                std::cerr << "Error: File write failed. Disabling file output.\n";
-                configFlags.fetch_and(~BDL_C_FLAG_FILE_OUTPUT, std::memory_order_relaxed);
+            double totalMicros = static_cast<double>(site->totalNanos.exchange(0, std::memory_order_relaxed)) / 1000.0;
+            double maxMicros = static_cast<double>(site->maxNanos.exchange(0, std::memory_order_relaxed)) / 1000.0;
+            auto count_ = kv("count", count);
+            auto total = kv("total_us", totalMicros);
+            double averageMicros = totalMicros / static_cast<double>(count);
+            auto average = kv("avg_us", averageMicros);
+            auto max = kv("max_us", maxMicros);
+            size_t length = structuredRecordSize(site->name, count_, total, average, max);
+            scopeRecord.resize(length);
+            encodeStructuredRecord(&scopeRecord[0], length, timestampClock::now(timestampSource), scopeLevel, currentThreadId(),
+                site->name, count_, total, average, max);
+            mainBuffer.appendStructured(scopeRecord, scopeLevel);
+            addBufferedInternal(length);
+        }
+    }
+    // Buffers "Suppressed K messages at file:line" for the sampled statements that went quiet
+    // with calls still unreported, once their summary interval is up unless forced (assumes lock is held)
+    void emitSuppressedInternal(bool force) {
+        std::lock_guard<std::mutex> lock(callSitesMtx);
+        for (callSiteLimiter* site : callSites) {
+            unsigned long long count = site->pendingSummary(force);
+            if (!count) {
+                continue;
             }
+            size_t before = mainBuffer.size();
+            mainBuffer.setLevel(site->level);
+            mainBuffer << severityPrefix(site->level) << "Suppressed " << count << " messages at " << site->file << ':'
+                       << static_cast<unsigned long long>(site->line) << '\n';
+            addBufferedInternal(mainBuffer.size() - before);
+        }
+    }
+    // Hands the spans collected from the stages to the output (assumes lock is held)
+    void takeTraceEventsInternal() {
+        if (traceEvents.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(traceMtx);
+        traceBatch.insert(traceBatch.end(), traceEvents.begin(), traceEvents.end());
+        traceEvents.clear();
+    }
+    // Appends the collected BDL_SCOPE timings to the trace file as Chrome trace events. Runs
+    // without mtx on the flushing thread, traceMtx keeps setScopeTraceFile() out meanwhile
+    void writeTraceInternal() {
+        std::lock_guard<std::mutex> lock(traceMtx);
+        if (traceBatch.empty()) {
+            return;
+        }
+        if (traceFName.empty()) { // Turned off since these spans were collected
+            traceBatch.clear();
+            return;
         }
-        mainBuffer.str("");
+        if (!traceFile) {
+            traceFile = std::make_unique<std::ofstream>(traceFName, std::ios::binary | std::ios::trunc);
+            *traceFile << "[\n"; // JSON array format, the closing bracket is optional
+        }
+#ifdef BDL_POSIX
+        unsigned long long pid = static_cast<unsigned long long>(::getpid());
+#else
+        unsigned long long pid = 0;
+#endif
+        traceText.clear();
+        char digits[32];
+        for (const traceEvent& trace : traceBatch) {
+            const threadStage::scopeEvent& e = trace.event;
+            traceText.append("{\"name\":");
+            appendJsonString(traceText, e.site->name);
+            traceText.append(",\"ph\":\"X\",\"ts\":");
+            unsigned long long relative = e.start > traceBase ? e.start - traceBase : 0;
+            appendNumber(traceText, relative / 1000);
+            traceText += '.';
+            traceText.append(digits, static_cast<size_t>(std::snprintf(digits, sizeof(digits), "%03llu", relative % 1000)));
+            traceText.append(",\"dur\":");
+            appendNumber(traceText, e.nanos / 1000);
+            traceText += '.';
+            traceText.append(digits, static_cast<size_t>(std::snprintf(digits, sizeof(digits), "%03llu", e.nanos % 1000)));
+            traceText.append(",\"pid\":");
+            appendNumber(traceText, pid);
+            traceText.append(",\"tid\":");
+            appendNumber(traceText, trace.threadId);
+            traceText.append(",\"args\":{\"depth\":");
+            appendNumber(traceText, e.depth);
+            traceText.append("}},\n");
+        }
+        *traceFile << traceText;
+        traceFile->flush();
+        if (!*traceFile) {
+            std::cerr << "Error: Trace file write failed. Disabling the trace file.\n";
+            scopeMode.fetch_and(static_cast<unsigned char>(~4), std::memory_order_relaxed);
+        }
+        traceBatch.clear();
+    }
+    // Async mode: takes the buffered data under the lock, writes it after releasing it
+    void flushAsyncInternal() {
+        collectBatchInternal();
+        writeOutputInternal(flushBatch);
+        finishBatchInternal();
+    }
+    void collectBatchInternal() {
+        std::lock_guard<mutexType> lock(mtx);
+        drainRingInternal();
+        collectStagesInternal();
+        takeRepeatsInternal();
+        emitScopeStatsInternal(false);
+        emitSuppressedInternal(false);
+        takeTraceEventsInternal();
+        mainBuffer.recycleFrom(flushBatch); // Chunks written by the previous flush
+        mainBuffer.moveTo(flushBatch);
+        binaryBatch.swap(binaryBuffer);
         autoOutputCounter = 0;
+        pendingBytes = 0;
+        overwrittenSinceOutput = 0;
+        overwriteMarkerAtFront = false;
+#if BDL_STATS
+        batchStart = std::chrono::steady_clock::now();
+#endif
+    }
+    void finishBatchInternal() {
+        size_t bytes = flushBatch.size();
+        if (!fanOutInternal(flushBatch)) {
+            releaseBufferedInternal(bytes);
+        }
+        writeBinaryInternal(binaryBatch);
+        writeTraceInternal();
+#if BDL_STATS
+        if (bytes || !binaryBatch.empty()) {
+            countFlushInternal(batchStart);
+        }
+#endif
+        flushBatch.clear();
+        binaryBatch.clear();
+    }
+    // sharedBackend::client, called on the backend's I/O thread
+    const chunkBuffer* collectBatch(sharedBackend::fileHandle*& file, bool& console) override {
+        flushWakeSent = false;
+        collectBatchInternal();
+        return prepareOutputInternal(flushBatch, file, console);
+    }
+    void finishBatch() override {
+        checkFileInternal();
+        syncOutputInternal();
+        finishBatchInternal();
+    }
+    void flusherLoop() {
+        flusherState& state = *flusher;
+        std::unique_lock<std::mutex> lock(state.mtx);
+        while (!state.stop) {
+            // Wakes on the byte threshold, an explicit logOutput() or the latency deadline
+            state.cv.wait_for(lock, flushLatency, [&] {
+                return state.stop || state.requested != state.completed || flushWakeSent.load(std::memory_order_relaxed);
+            });
+            unsigned long long serving = state.requested;
+            flushWakeSent = false;
+            lock.unlock();
+            flushAsyncInternal();
+            lock.lock();
+            state.completed = serving;
+            state.doneCv.notify_all();
+        }
+    }
+    void startFlusherInternal() {
+        if (!flusher) {
+            flusher = std::make_unique<flusherState>();
+        }
+        flusher->stop = false;
+        flusher->thread = std::thread(&basicLogger::flusherLoop, this);
+#ifdef __linux__
+        if (flusherCpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(flusherCpu, &cpus);
+            if (pthread_setaffinity_np(flusher->thread.native_handle(), sizeof(cpus), &cpus) != 0) {
+                std::cerr << "Error: Could not pin flusher thread to CPU " << flusherCpu << ".\n";
+            }
+        }
+#endif
+        flusherRunning = true;
+    }
+    // Called after every buffered record; producers never do I/O while the flusher runs
+    void scheduleOutputInternal(size_t bytes, bool lockHeld) {
+        short flags = flagsInternal();
+        if (flusherRunning.load(std::memory_order_relaxed)) {
+            bool wake = pendingBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes >= flushThreshold;
+            if ((flags & BDL_C_FLAG_AUTO_OUTPUT) && ++autoOutputCounter >= autoOutputInterval) {
+                wake = true;
+            }
+            if (wake && !flushWakeSent.exchange(true, std::memory_order_relaxed)) {
+                wakeFlusherInternal();
+            }
+            return;
+        }
+        if ((flags & BDL_C_FLAG_AUTO_OUTPUT) && ++autoOutputCounter >= autoOutputInterval) {
+            if (lockHeld) {
+                debugOutputInternal(); // Private helper (assumes lock is held)
+                return;
+            }
+            std::unique_lock<mutexType> lock(mtx, std::try_to_lock); // Someone else is already draining otherwise
+            if (lock) {
+                debugOutputInternal();
+            }
+        }
+    }
+    static void categorySignalHandler(int) {
+        categorySignals.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Reads the category config, returns false if it cannot be read
+    bool readCategoryConfigInternal(const std::string& path, std::string& text) {
+        std::ifstream in(path);
+        if (!in) {
+            return false;
+        }
+        std::stringstream content;
+        content << in.rdbuf();
+        text = content.str();
+        return true;
+    }
+    void applyCategoryConfigInternal(const std::string& path, const std::string& text) {
+        if (unsigned errors = categories.apply(text)) {
+            std::cerr << "Error: " << errors << " lines of " << path << " not understood. Ignoring them.\n";
+        }
+    }
+    // Re-applies the config file when its contents change or the reload signal arrived
+    void categoryWatchLoop(unsigned long long appliedHash) {
+        unsigned seenSignals = categorySignals.load(std::memory_order_relaxed);
+        std::string text;
+        std::unique_lock<std::mutex> lock(categoryWatchMtx);
+        while (!categoryWatchCv.wait_for(lock, categoryWatchInterval, [this] { return stopCategoryWatcher; })) {
+            std::string path = categoryConfigPath; // loadCategoryConfig() may change it meanwhile
+            lock.unlock();
+            unsigned signals = categorySignals.load(std::memory_order_relaxed);
+            if (readCategoryConfigInternal(path, text)) {
+                unsigned long long hash = hashMessage(text);
+                if (hash != appliedHash || signals != seenSignals) {
+                    applyCategoryConfigInternal(path, text);
+                    appliedHash = hash;
+                }
+            }
+            seenSignals = signals;
+            lock.lock();
+        }
+    }
+    // Body of initialize() (assumes lock is held). wasInitialized is set last, so the lock-free
+    // paths only see a fully set up logger
+    void initializeInternal() {
+        if (logLevel.empty()) {
+            std::cerr << "Error: Debug level not set." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        mainBuffer.clear(); // Clear the main buffer
+        mainBuffer.setLevel(severity::error); // Configuration errors below
+        loopCheckBuffer.reset(static_cast<size_t>(looplimit > 0 ? looplimit : 1)); // Clear the loop check buffer
+        autoOutputCounter = 0; // Reset auto output counter
+        if (timestampSource == clockSource::tsc) {
+            timestampClock::calibrate();
+        }
+        if (patternText.empty()) {
+            pattern = linePattern();
+        }
+        else if (!pattern.compile(patternText)) { // Parsed once, every message just runs the steps
+            mainBuffer << "Error: Pattern has no %v placeholder. Appending the message at the end.\n";
+        }
+        if ((flagsInternal() & BDL_C_FLAG_LOCK_FREE) && ring.capacity() < ringCapacity) {
+            ring.reserve(ringCapacity); // Preallocate the record slots
+        }
+        if (flagsInternal() & BDL_C_FLAG_FILE_OUTPUT) {
+            if (fName.empty() && (fixedMask & BDL_C_FLAG_FILE_OUTPUT)) { // A policy keeps it on, nothing to fall back to
+                std::cerr << "Error: File name not set but a policy fixes file output on." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            if (fName.empty()) {
+                mainBuffer << "Error: File name not set for file output but file output enabled. Defaulting to console output.\n";
+                configFlags &= ~BDL_C_FLAG_FILE_OUTPUT; // Disable file output
+                configFlags |= BDL_C_FLAG_CONSOLE_OUTPUT; // Enable console output
+            }
+        }
+        if ((flagsInternal() & BDL_C_FLAG_FILE_OUTPUT) && (flagsInternal() & BDL_C_FLAG_MAPPED_FILE)) {
+#ifdef BDL_POSIX
+            if (!mappedFile && !(mappedFile = sharedBackend::instance().openMapped(fName, fileSegmentSize, maxFiles))) {
+                mainBuffer << "Error: Could not map " << fName << " (or another logger appends to it). Falling back to stream file output.\n";
+                configFlags &= ~BDL_C_FLAG_MAPPED_FILE;
+            }
+#else
+            mainBuffer << "Error: Mapped file output is not supported on this platform. Falling back to stream file output.\n";
+            configFlags &= ~BDL_C_FLAG_MAPPED_FILE;
+#endif
+        }
+        if (flagsInternal() & BDL_C_FLAG_FLIGHT_RECORDER) {
+#ifdef BDL_POSIX
+            if (!flight.isOpen()) {
+                flight.reserve(flightRecorderSize);
+            }
+            flight.setFd(crashDumpFd);
+            if (!crashDumpPath.empty() && !flight.setPath(crashDumpPath)) {
+                mainBuffer << "Error: Crash dump path too long. Dumping to the crash dump fd instead.\n";
+            }
+            if (!flight.registerForCrashes()) {
+                mainBuffer << "Error: Too many flight recorders. This one is only dumped on fatal messages.\n";
+            }
+#else
+            mainBuffer << "Error: Flight recorder is not supported on this platform. Disabling it.\n";
+            configFlags &= ~BDL_C_FLAG_FLIGHT_RECORDER;
+#endif
+        }
+        if ((flagsInternal() & BDL_C_FLAG_BINARY_OUTPUT) && binaryFName.empty()) {
+            mainBuffer << "Error: Binary file name not set but binary output enabled. Disabling binary output.\n";
+            configFlags &= ~BDL_C_FLAG_BINARY_OUTPUT;
+        }
+        bufferedBytes = bufferLimit ? mainBuffer.size() : 0;
+        wasInitialized = true;
+    }
+    // Second half of initialize(), without mtx: the I/O thread of the shared backend takes mtx
+    // while it holds its own lock
+    void startOutputInternal() {
+        std::lock_guard<std::mutex> lock(outputStartMtx);
+        if ((flagsInternal() & BDL_C_FLAG_SHARED_BACKEND) && !attachedToBackend) {
+            attachedToBackend = true;
+            flusherRunning = true;
+            sharedBackend::instance().attach(*this, flushLatency);
+        }
+        else if ((flagsInternal() & BDL_C_FLAG_ASYNC_OUTPUT) && !(flusher && flusher->thread.joinable()) && !attachedToBackend) {
+            startFlusherInternal();
+        }
+    }
+    // The first message before initialize() initializes with the configuration set so far. Its
+    // notice is buffered directly: logInternal() would take mtx again and reuse the line scratch
+    void initializeOnFirstUseInternal() {
+        {
+            std::lock_guard<mutexType> lock(mtx);
+            if (wasInitialized) { // Another thread was first
+                return;
+            }
+            initializeInternal();
+            std::string notice;
+            std::string_view text = "BDL not initialized. Initializing now with default configuration.";
+            unsigned long long timestamp = lineTimeInternal();
+            size_t noticeOffset = formatLineInternal(notice, timestamp, logLevelName, logLevel, text, {});
+            bufferMessageInternal(notice, noticeOffset, text.size(), defaultSeverity, timestamp);
+            addBufferedInternal(notice.size());
+        }
+        startOutputInternal();
     }
 public:
+    basicLogger() = default;
+    ~basicLogger() {
+        {
+            std::lock_guard<mutexType> lock(mtx);
+            emitSuppressedInternal(true); // Written by the final drain below
+        }
+        if (categoryWatcher.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(categoryWatchMtx);
+                stopCategoryWatcher = true;
+            }
+            categoryWatchCv.notify_one();
+            categoryWatcher.join();
+        }
+        if (attachedToBackend) {
+            sharedBackend::instance().detach(*this);
+            attachedToBackend = false;
+            flusherRunning = false;
+            flushAsyncInternal(); // Final drain, on this thread now
+        }
+        if (flusher && flusher->thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(flusher->mtx);
+                flusher->stop = true;
+            }
+            flusher->cv.notify_one();
+            flusher->thread.join();
+            flusherRunning = false;
+            flushAsyncInternal(); // Final drain of whatever arrived during shutdown
+        }
+        for (const std::unique_ptr<sinkEntry>& entry : sinks) {
+            stopSinkInternal(*entry);
+        }
+        for (scopeSite* site : scopeSites) { // The next logger using them reports them instead
+            const void* self = this;
+            site->owner.compare_exchange_strong(self, nullptr);
+        }
+        for (callSiteLimiter* site : callSites) {
+            const void* self = this;
+            site->owner.compare_exchange_strong(self, nullptr);
+        }
+#ifdef BDL_POSIX
+        mappedFile.reset(); // The last logger mapping the file truncates the preallocated segment
+        flight.unregister();
+#endif
+    }
     void setFilePath(const std::string& fileName) {
         fName = fileName;
     }
+    void setBinaryFilePath(const std::string& fileName) {
+        binaryFName = fileName;
+    }
     void setLogLevel(const std::string& level) {
         logLevel = '[' + level + ']';
+        logLevelName = level;
+        defaultSeverity = severityFromName(level); // Severity of the messages logged without an explicit one
+    }
+    // Runtime threshold, checked before any formatting work
+    void setMinLevel(severity level) {
+        minSeverity.store(static_cast<unsigned char>(level), std::memory_order_relaxed);
+    }
+    bool shouldLog(severity level) const {
+        return static_cast<unsigned char>(level) >= minSeverity.load(std::memory_order_relaxed);
     }
     void setLoopLimit(short limit) {
+        std::lock_guard<mutexType> lock(mtx);
         looplimit = limit;
+        loopCheckBuffer.reset(static_cast<size_t>(limit > 0 ? limit : 1)); // Number of distinct messages remembered
+    }
+    // Number of preallocated slots for the lock-free mode, applied by initialize()
+    void setRingCapacity(size_t slots) {
+        ringCapacity = slots;
+    }
+    // Async mode flush policy: pending byte threshold, max latency and optional CPU pinning of the flusher
+    void setFlushThreshold(size_t bytes) {
+        flushThreshold = bytes;
+    }
+    void setFlushLatency(std::chrono::milliseconds latency) {
+        flushLatency = latency;
+    }
+    void setFlusherCpu(int cpu) {
+        flusherCpu = cpu;
+    }
+    // Mapped file output: segment size preallocated per file and how many rotated files are kept
+    void setFileSegmentSize(size_t bytes) {
+        fileSegmentSize = bytes;
+    }
+    void setMaxFiles(unsigned files) {
+        maxFiles = files;
+    }
+    // Flight recorder: ring size and where crash dumps go, a path is only opened when dumping
+    void setFlightRecorderSize(size_t bytes) {
+        flightRecorderSize = bytes;
+    }
+    void setCrashDumpFd(int fd) {
+        crashDumpFd = fd;
+        crashDumpPath.clear();
+    }
+    void setCrashDumpPath(const std::string& path) {
+        crashDumpPath = path;
+    }
+    // Line pattern compiled by initialize(), e.g. "%Y-%m-%d %H:%M:%S.%e [%L] %T %v".
+    // Replaces the default "[level]message" layout, an empty pattern restores it
+    void setPattern(const std::string& linePatternText) {
+        patternText = linePatternText;
+    }
+    // Timestamp clock and number of sub-second digits (0, 3, 6 or 9)
+    void setTimestampClock(clockSource source) {
+        if (source == clockSource::tsc) {
+            timestampClock::calibrate(); // Rather than in the first message
+        }
+        timestampSource = source;
+    }
+    void setTimestampPrecision(unsigned digits) {
+        timestampDigits = std::min(digits, 9u);
+    }
+    // How the console and file output render structured records: text or json (binary is for sinks)
+    void setStructuredFormat(structuredFormat format) {
+        if (format == structuredFormat::binary) {
+            std::cerr << "Error: Binary structured output is only available for sinks. Keeping the current format.\n";
+            return;
+        }
+        structuredOutput = format;
+    }
+    // Extra output target with its own level threshold. flushInterval: how often the sink's flush()
+    // runs at most, 0 after every output. ownThread: the sink writes on its own thread, so a slow
+    // sink never holds back the logger or the other sinks. format: how the sink gets structured
+    // records, see log(level, message, kv(...)...)
+    void addSink(std::shared_ptr<logSink> target, severity minLevel = severity::trace,
+                 std::chrono::milliseconds flushInterval = std::chrono::milliseconds(0), bool ownThread = false,
+                 structuredFormat format = structuredFormat::text) {
+        std::unique_ptr<sinkEntry> entry(new sinkEntry);
+        entry->target = std::move(target);
+        entry->minLevel = minLevel;
+        entry->format = format;
+        entry->takesSpans = entry->target->takesSpans();
+        stampingSinks += entry->takesSpans;
+        entry->flushInterval = flushInterval;
+        entry->lastFlush = std::chrono::steady_clock::now();
+        if (ownThread) {
+            entry->worker = std::thread(&basicLogger::sinkLoop, this, std::ref(*entry));
+        }
+        std::lock_guard<std::mutex> lock(sinksMtx);
+        sinks.push_back(std::move(entry));
+    }
+    void removeSink(const std::shared_ptr<logSink>& target) {
+        std::unique_ptr<sinkEntry> removed;
+        {
+            std::lock_guard<std::mutex> lock(sinksMtx);
+            auto found = std::find_if(sinks.begin(), sinks.end(), [&](const std::unique_ptr<sinkEntry>& entry) {
+                return entry->target == target;
+            });
+            if (found == sinks.end()) {
+                return;
+            }
+            removed = std::move(*found);
+            sinks.erase(found);
+        }
+        stampingSinks -= removed->takesSpans;
+        stopSinkInternal(*removed);
+    }
+    // Bounds the buffered text to bytes (0: unbounded), see setOverflowPolicy(). Set before initialize()
+    void setBufferLimit(size_t bytes) {
+        bufferLimit = bytes;
+    }
+    // What happens to a message that does not fit, blockTimeout is how long block waits for space
+    void setOverflowPolicy(overflowPolicy policy, std::chrono::milliseconds timeout = std::chrono::milliseconds(100)) {
+        overflow = policy;
+        blockTimeout = timeout;
+    }
+    // Snapshot of the self-metrics, all zero unless built with BDL_STATS. Only reads counters,
+    // producers keep running while it is taken
+    loggerStats getStats() {
+        loggerStats stats{};
+#if BDL_STATS
+        {
+            std::lock_guard<std::mutex> lock(stagesMtx); // Keeps threads from registering or retiring meanwhile
+            stats.messagesAccepted = retiredStats.messages.load(std::memory_order_relaxed);
+            stats.bytesBuffered = retiredStats.bytes.load(std::memory_order_relaxed);
+            stats.lockWaits = retiredStats.lockWaits.load(std::memory_order_relaxed);
+            stats.lockWaitNanos = retiredStats.lockWaitNanos.load(std::memory_order_relaxed);
+            for (const std::shared_ptr<threadStage>& stage : stages) {
+                stats.messagesAccepted += stage->stats.messages.load(std::memory_order_relaxed);
+                stats.bytesBuffered += stage->stats.bytes.load(std::memory_order_relaxed);
+                stats.lockWaits += stage->stats.lockWaits.load(std::memory_order_relaxed);
+                stats.lockWaitNanos += stage->stats.lockWaitNanos.load(std::memory_order_relaxed);
+            }
+        }
+        stats.loopSuppressed = statLoopSuppressed.load(std::memory_order_relaxed);
+        stats.flushes = statFlushes.load(std::memory_order_relaxed);
+        stats.flushNanos = statFlushNanos.load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < BDL_STATS_BUCKETS; ++i) {
+            stats.flushHistogram[i] = statFlushHistogram[i].load(std::memory_order_relaxed);
+        }
+#endif
+        stats.drops = getDropCounters();
+        return stats;
+    }
+    dropCounters getDropCounters() const {
+        return { droppedNewestCount.load(), blockTimeoutCount.load(), overwrittenCount.load() };
     }
     void setAutoOutputInterval(short interval) {
         autoOutputInterval = interval;
@@ -90,43 +4826,470 @@ public:
             configFlags &= ~BDL_C_FLAG_LOOP_CHECK;
         }
     }
+    // Lock-free mode: producers only claim a ring slot and copy the record,
+    // loop check and output run on whoever drains the ring. Set before initialize()
+    void setLockFree(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_LOCK_FREE;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_LOCK_FREE;
+        }
+    }
+    // Async mode: a background thread started by initialize() does all the output,
+    // producers only buffer and wake it up
+    void setAsyncOutput(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_ASYNC_OUTPUT;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_ASYNC_OUTPUT;
+        }
+    }
+    // Named category, e.g. one per subsystem: messages logged with it get a "[LEVEL][name]" prefix
+    // (%C in a line pattern) and are only built when the category is on at their level, see
+    // BDL_LOG_CAT. Returns BDL_MAX_CATEGORIES when there is no room left
+    categoryId addCategory(const std::string& name, severity minLevel = severity::info, bool enabled = true) {
+        categoryId id = categories.add(name, minLevel, enabled);
+        if (id == BDL_MAX_CATEGORIES) {
+            std::cerr << "Error: No room for category " << name << ". Its messages are dropped.\n";
+        }
+        return id;
+    }
+    categoryId findCategory(std::string_view name) const {
+        return categories.find(name);
+    }
+    // Safe to call while other threads log, they see the change on their next message
+    void setCategoryEnabled(categoryId category, bool enabled) {
+        categories.enable(category, enabled);
+    }
+    void setCategoryLevel(categoryId category, severity level) {
+        categories.setLevel(category, level);
+    }
+    // Applies a category config file once: "name = on|off|level" lines, '*' for all categories
+    bool loadCategoryConfig(const std::string& path) {
+        {
+            std::lock_guard<std::mutex> lock(categoryWatchMtx);
+            categoryConfigPath = path;
+        }
+        std::string text;
+        if (!readCategoryConfigInternal(path, text)) {
+            std::cerr << "Error: Could not read category config " << path << ".\n";
+            return false;
+        }
+        applyCategoryConfigInternal(path, text);
+        return true;
+    }
+    // Applies the config file now and again whenever its contents change, checked every interval
+    // on a watcher thread. Call once
+    bool watchCategoryConfig(const std::string& path, std::chrono::milliseconds interval = std::chrono::milliseconds(1000)) {
+        if (categoryWatcher.joinable()) {
+            std::cerr << "Error: Category config already watched. Ignoring " << path << ".\n";
+            return false;
+        }
+        bool loaded = loadCategoryConfig(path);
+        std::string text;
+        unsigned long long appliedHash = loaded && readCategoryConfigInternal(path, text) ? hashMessage(text) : 0;
+        categoryWatchInterval = interval;
+        categoryWatcher = std::thread(&basicLogger::categoryWatchLoop, this, appliedHash);
+        return loaded;
+    }
+#ifdef BDL_POSIX
+    // The watcher re-applies the config file at its next check when this signal arrives (e.g.
+    // SIGUSR1), even if the file did not change. The handler only bumps a counter
+    bool setCategoryReloadSignal(int signal) {
+        struct sigaction action{};
+        action.sa_handler = &basicLogger::categorySignalHandler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        if (sigaction(signal, &action, nullptr) != 0) {
+            std::cerr << "Error: Could not install the category reload handler for signal " << signal << ".\n";
+            return false;
+        }
+        return true;
+    }
+#endif
+    // Shared backend: this logger is flushed by the process-wide I/O thread together with every
+    // other logger that has it set, instead of by its own flusher (see sharedBackend). Set before
+    // initialize(), takes precedence over setAsyncOutput()
+    void setSharedBackend(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_SHARED_BACKEND;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_SHARED_BACKEND;
+        }
+    }
+    // Async file writer: the file output is copied into a pool of buffers and written by io_uring,
+    // or by a pwrite thread where io_uring is unavailable, so an output never waits for the disk
+    // (only for a free buffer). Applies to every logger sharing the file. Set before initialize()
+    void setAsyncFileWriter(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_ASYNC_FILE;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_ASYNC_FILE;
+        }
+    }
+    // Durable flush: a fatal message returns only once it is on disk, see logOutputDurable()
+    void setDurableFlush(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_DURABLE_FLUSH;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_DURABLE_FLUSH;
+        }
+    }
+    // Mapped file output: file output goes through preallocated memory-mapped segments
+    // with size based rotation instead of an ofstream. Set before initialize()
+    void setMappedFileOutput(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_MAPPED_FILE;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_MAPPED_FILE;
+        }
+    }
+    // Timestamps: prefixes every line with the local date and time
+    void setTimestamps(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_TIMESTAMPS;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_TIMESTAMPS;
+        }
+    }
+    // Flight recorder mode: lines only go into a fixed ring in memory, nothing is written until a
+    // crash signal (SIGSEGV, SIGABRT, SIGBUS), a fatal message or dumpFlightRecorder(). POSIX only
+    void setFlightRecorder(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_FLIGHT_RECORDER;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_FLIGHT_RECORDER;
+        }
+    }
+    // Binary output: BDL_LOG_BINARY records go to setBinaryFilePath(), see decodeBinaryLog()
+    void setBinaryOutput(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_BINARY_OUTPUT;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_BINARY_OUTPUT;
+        }
+    }
+    // Thread buffer mode: every producer thread appends to its own staging buffer, the buffers
+    // are merged by timestamp when output runs. Takes precedence over the lock-free mode
+    void setThreadBuffers(bool enable) {
+        if (enable) {
+            configFlags |= BDL_C_FLAG_THREAD_BUFFERS;
+        }
+        else {
+            configFlags &= ~BDL_C_FLAG_THREAD_BUFFERS;
+        }
+    }
+    // Applies the configuration set so far. Called by the first message otherwise
     void initialize() {
-        wasInitialized = true;
-        if (logLevel.empty()) {
-            std::cerr << "Error: Debug level not set." << std::endl;
-            exit(EXIT_FAILURE);
+        {
+            std::lock_guard<mutexType> lock(mtx);
+            initializeInternal();
         }
-        mainBuffer.str(""); // Clear the main buffer
-        loopCheckBuffer.clear(); // Clear the loop check buffer
-        autoOutputCounter = 0; // Reset auto output counter
-        if ((configFlags & BDL_C_FLAG_FILE_OUTPUT) == 1) {
-            if (fName.empty()) {
-                mainBuffer << "Error: File name not set for file output but file output enabled. Defaulting to console output.\n";
-                configFlags &= ~BDL_C_FLAG_FILE_OUTPUT; // Disable file output
-                configFlags |= BDL_C_FLAG_CONSOLE_OUTPUT; // Enable console output
+        startOutputInternal();
+    }
+    bool shouldLog(categoryId category, severity level) const {
+        return categories.enabledAt(category, level);
+    }
+    // Body of BDL_LOG_CAT, same argument formatting as logMessage(args...). Checks nothing, the
+    // macro already did
+    template <class... Args>
+    void logCategory(categoryId category, severity level, const Args&... args) {
+        if constexpr (sizeof...(Args) == 1 && (std::is_convertible_v<const Args&, std::string_view> && ...)) {
+            logInternal(level, severityName(level), categories.prefix(category, level), std::string_view(args...), categories.name(category));
+        }
+        else {
+            std::string& message = messageScratch();
+            message.clear();
+            (appendValue(message, args), ...);
+            logInternal(level, severityName(level), categories.prefix(category, level), message, categories.name(category));
+        }
+    }
+    // Lambda form of BDL_LOG_CAT: build() only runs when the category is on at level
+    template <class Build>
+    void logLazy(categoryId category, severity level, Build&& build) {
+        if (shouldLog(category, level)) {
+            logCategory(category, level, build());
+        }
+    }
+    // BDL_SCOPE spans taking at least threshold are logged at level as "name dur_us=.. depth=..",
+    // 0 turns it off. The spans are timed with the TSC clock where available
+    void setScopeThreshold(std::chrono::nanoseconds threshold, severity level = severity::info) {
+        timestampClock::calibrate(); // Now rather than in the first span
+        scopeLevel = level;
+        scopeThresholdNanos = static_cast<unsigned long long>(std::max<long long>(threshold.count(), 0));
+        if (threshold.count() > 0) {
+            scopeMode |= 1;
+        }
+        else {
+            scopeMode &= static_cast<unsigned char>(~1);
+        }
+    }
+    // Count, total, average and max per BDL_SCOPE name, logged every interval by the output and
+    // by logScopeStats()
+    void setScopeStats(bool enable, std::chrono::milliseconds interval = std::chrono::milliseconds(10000)) {
+        timestampClock::calibrate();
+        {
+            std::lock_guard<mutexType> lock(mtx);
+            scopeStatsInterval = interval;
+        }
+        if (enable) {
+            scopeMode |= 2;
+        }
+        else {
+            scopeMode &= static_cast<unsigned char>(~2);
+        }
+    }
+    // Every BDL_SCOPE span is written to path as a Chrome trace event (chrome://tracing, Perfetto).
+    // The file is rewritten from the start, an empty path turns it off
+    void setScopeTraceFile(const std::string& path) {
+        timestampClock::calibrate();
+        std::lock_guard<std::mutex> lock(traceMtx);
+        traceFile.reset();
+        traceFName = path;
+        traceBase = timestampClock::now(clockSource::tsc);
+        if (!path.empty()) {
+            scopeMode |= 4;
+        }
+        else {
+            scopeMode &= static_cast<unsigned char>(~4);
+        }
+    }
+    // Logs the BDL_SCOPE aggregates now instead of waiting for the interval
+    void logScopeStats() {
+        std::lock_guard<mutexType> lock(mtx);
+        emitScopeStatsInternal(true);
+    }
+    // Logs the pending counts of the sampled statements now instead of waiting for the interval
+    void logSuppressed() {
+        std::lock_guard<mutexType> lock(mtx);
+        emitSuppressedInternal(true);
+    }
+    // Called by BDL_LOG_EVERY_N, BDL_LOG_FIRST_N and BDL_LOG_RATE for a suppressed call
+    void trackCallSite(callSiteLimiter& site) {
+        const void* owner = site.owner.load(std::memory_order_relaxed);
+        if (!owner && site.owner.compare_exchange_strong(owner, this)) {
+            std::lock_guard<std::mutex> lock(callSitesMtx);
+            callSites.push_back(&site);
+        }
+    }
+    bool scopesEnabled() const {
+        return scopeMode.load(std::memory_order_relaxed) != 0;
+    }
+    // Called by scopeTimer when a span ends
+    void endScope(scopeSite& site, unsigned long long start, unsigned long long nanos, unsigned depth) {
+        unsigned char mode = scopeMode.load(std::memory_order_relaxed);
+        if ((mode & 1) && nanos >= scopeThresholdNanos.load(std::memory_order_relaxed)) {
+            log(scopeLevel, site.name, kv("dur_us", static_cast<double>(nanos) / 1000.0), kv("depth", depth));
+        }
+        if (mode & 2) {
+            site.add(nanos);
+            const void* owner = site.owner.load(std::memory_order_relaxed);
+            if (!owner && site.owner.compare_exchange_strong(owner, this)) {
+                std::lock_guard<std::mutex> lock(scopeSitesMtx);
+                scopeSites.push_back(&site);
+            }
+        }
+        if (mode & 4) {
+            threadStage& stage = localStageInternal();
+            bool due;
+            {
+                std::lock_guard<std::mutex> lock(stage.mtx);
+                stage.scopes.push_back({ start, nanos, &site, depth });
+                due = stage.scopes.size() >= 4096;
+            }
+            if (due) { // Spans are otherwise only picked up by the next output
+                if (flusherRunning.load(std::memory_order_relaxed)) {
+                    if (!flushWakeSent.exchange(true, std::memory_order_relaxed)) {
+                        wakeFlusherInternal();
+                    }
+                }
+                else {
+                    std::unique_lock<mutexType> lock(mtx, std::try_to_lock);
+                    if (lock) {
+                        debugOutputInternal();
+                    }
+                }
             }
         }
     }
-    void logMessage(std::string message) {
-        std::lock_guard<std::mutex> lock(mtx); // Lock held for entire function
-        if (!wasInitialized) {
-            initialize();
-            logMessage("BDL not initialized. Initializing now with default configuration.");
+    void logMessage(std::string_view message) {
+        if (shouldLog(defaultSeverity)) {
+            logInternal(defaultSeverity, logLevelName, logLevel, message);
+        }
+    }
+    void logMessage(severity level, std::string_view message) {
+        if (shouldLog(level)) {
+            logInternal(level, severityName(level), severityPrefix(level), message);
+        }
+    }
+    // logMessage("took ", micros, " us for ", name) / logMessage(BDL::severity::warn, ...) /
+    // logMessage(42): integers, floats, strings and pointers are formatted straight into a reused
+    // per-thread buffer, nothing is allocated once the buffers have grown to the usual message
+    // size. A single string goes to the overloads above
+    template <class First, class... Rest,
+              std::enable_if_t<(sizeof...(Rest) > 0 || !(std::is_convertible_v<const First&, std::string_view> || std::is_same_v<First, severity>)), int> = 0>
+    void logMessage(const First& first, const Rest&... rest) {
+        std::string& message = messageScratch();
+        message.clear();
+        if constexpr (std::is_same_v<First, severity>) {
+            if (shouldLog(first)) {
+                (appendValue(message, rest), ...);
+                logInternal(first, severityName(first), severityPrefix(first), message);
+            }
+        }
+        else if (shouldLog(defaultSeverity)) {
+            appendValue(message, first);
+            (appendValue(message, rest), ...);
+            logInternal(defaultSeverity, logLevelName, logLevel, message);
+        }
+    }
+    // logf("took {} us for {}", micros, name): "{}" placeholders, same formatting as above
+    template <class... Args>
+    void logf(std::string_view format, const Args&... args) {
+        if (shouldLog(defaultSeverity)) {
+            std::string& message = messageScratch();
+            message.clear();
+            appendFormatted(message, format, args...);
+            logInternal(defaultSeverity, logLevelName, logLevel, message);
+        }
+    }
+    template <class... Args>
+    void logf(severity level, std::string_view format, const Args&... args) {
+        if (shouldLog(level)) {
+            std::string& message = messageScratch();
+            message.clear();
+            appendFormatted(message, format, args...);
+            logInternal(level, severityName(level), severityPrefix(level), message);
+        }
+    }
+    // log(BDL::severity::info, "request done", BDL::kv("req", id), BDL::kv("lat_us", micros)):
+    // the fields are copied as raw bytes into one record, text or JSON is only produced when the
+    // outputs write it (see setStructuredFormat() and addSink()). In flight recorder mode, or for
+    // a record larger than a buffer chunk, the fields are appended to the message as text instead
+    template <class... Fields>
+    void log(severity level, std::string_view message, const keyValue<Fields>&... fields) {
+        if (!shouldLog(level)) {
+            return;
+        }
+        std::string& record = recordScratch();
+        size_t length = structuredRecordSize(message, fields...);
+        record.resize(length);
+        encodeStructuredRecord(&record[0], length, timestampClock::now(timestampSource), level, currentThreadId(), message, fields...);
+        if (length > BDL_CHUNK_SIZE || (flagsInternal() & BDL_C_FLAG_FLIGHT_RECORDER)) {
+            std::string& text = messageScratch();
+            text.assign(message);
+            appendStructuredFields(text, structuredView(record.data()), false);
+            logInternal(level, severityName(level), severityPrefix(level), text);
+            return;
         }
-        if ((configFlags & BDL_C_FLAG_LOOP_CHECK) && !loopCheckBuffer.count(message)) {
-            loopCheckBuffer.insert(message);
-            mainBuffer << logLevel << message << std::endl;
+        logStructuredInternal(level, record);
+        if (level >= severity::fatal && (flagsInternal() & BDL_C_FLAG_DURABLE_FLUSH)) {
+            logOutputDurable();
+        }
+    }
+    // Hot path of BDL_LOG_BINARY: no formatting, only the raw argument bytes are copied
+    template <class FormatFn, class... Args>
+    void logBinary(FormatFn format, severity level, const Args&... args) {
+        static const unsigned formatId = binaryFormatRegistry::add(format(), { binaryTypeCode<Args>()... });
+        if (!(flagsInternal() & BDL_C_FLAG_BINARY_OUTPUT)) {
+            return;
         }
-        else if (!(configFlags & BDL_C_FLAG_LOOP_CHECK)) {
-            mainBuffer << logLevel << message << std::endl;
+        if (!wasInitialized) {
+            initializeOnFirstUseInternal();
         }
-        if ((configFlags & BDL_C_FLAG_AUTO_OUTPUT) && ++autoOutputCounter >= autoOutputInterval) {
-            debugOutputInternal(); // Private helper (assumes lock is held)
+        unsigned argBytes = static_cast<unsigned>((binaryArgSize(args) + ... + 0));
+        size_t length = BDL_BINARY_RECORD_HEADER + argBytes;
+        unsigned long long timestamp = timestampClock::now(timestampSource);
+#if BDL_STATS
+        countAcceptedInternal(length);
+#endif
+        if ((flagsInternal() & BDL_C_FLAG_LOCK_FREE) && wasInitialized && ring.capacity() && length <= mpscRing::payloadSize) {
+            if (mpscRing::slot* s = ring.claim()) {
+                encodeBinaryRecord(s->data, formatId, timestamp, level, argBytes, args...);
+                s->length = static_cast<unsigned short>(length);
+                s->messageOffset = 0;
+                s->messageLength = 0;
+                s->kind = mpscRing::binaryRecord;
+                s->level = static_cast<unsigned char>(level);
+                ring.publish(s);
+                scheduleOutputInternal(length, false);
+                return;
+            }
         }
+        std::unique_lock<mutexType> lock = lockProducerInternal();
+        drainRingInternal(true);
+        size_t offset = binaryBuffer.size();
+        binaryBuffer.resize(offset + length);
+        encodeBinaryRecord(&binaryBuffer[offset], formatId, timestamp, level, argBytes, args...);
+        scheduleOutputInternal(length, true);
+    }
+    // Writes the flight recorder ring to the crash dump target now
+    void dumpFlightRecorder() {
+#ifdef BDL_POSIX
+        flight.dump();
+#endif
     }
     void logOutput() {
-        std::lock_guard<std::mutex> lock(mtx);
+        if (attachedToBackend) {
+            sharedBackend::instance().flush();
+            return;
+        }
+        if (flusherRunning) { // Hand the flush to the background thread and wait for it
+            std::unique_lock<std::mutex> lock(flusher->mtx);
+            unsigned long long ticket = ++flusher->requested;
+            flusher->cv.notify_one();
+            flusher->doneCv.wait(lock, [&] { return flusher->completed >= ticket; });
+            return;
+        }
+        std::lock_guard<mutexType> lock(mtx);
         debugOutputInternal();
     }
+    // logOutput(), then waits until the file output is on disk (fdatasync, msync for the mapped
+    // file). Syncs requested during one output share one fdatasync
+    void logOutputDurable() {
+        durableRequested = true;
+        logOutput();
+    }
 }; // Ensure the class definition ends properly
+
+using loggerConstructor = basicLogger<>;
+
+// RAII span behind BDL_SCOPE: reads the clock twice, costs one load when no scope output is on
+template <class Logger>
+class scopeTimer {
+private:
+    Logger* logger;
+    scopeSite& site;
+    unsigned long long start = 0;
+    unsigned depth = 0;
+    static unsigned& currentDepth() {
+        thread_local unsigned depth = 0;
+        return depth;
+    }
+public:
+    scopeTimer(Logger& owner, scopeSite& scope) : logger(owner.scopesEnabled() ? &owner : nullptr), site(scope) {
+        if (logger) {
+            depth = currentDepth()++;
+            start = timestampClock::now(clockSource::tsc);
+        }
+    }
+    scopeTimer(const scopeTimer&) = delete;
+    scopeTimer& operator=(const scopeTimer&) = delete;
+    ~scopeTimer() {
+        if (logger) {
+            unsigned long long end = timestampClock::now(clockSource::tsc);
+            --currentDepth();
+            logger->endScope(site, start, end > start ? end - start : 0, depth);
+        }
+    }
+};
 } // Ensure the namespace ends properly
@@ -0,0 +1,112 @@
+// bdl-alloc-test: counts heap allocations with a replaced global operator new and checks that
+// logging does not allocate once the buffers have grown, on the mutex, lock-free and auto output
+// paths. Exits non-zero if any call allocated after the warm-up.
+// Build: g++ -std=c++17 -O2 -pthread tools/bdl-alloc-test.cpp -o bdl-alloc-test
+// Usage: bdl-alloc-test [--messages M] [--sink PATH]
+//   --messages  messages logged after the warm-up, per mode (default 100000)
+//   --sink      file the logger writes to (default /dev/null)
+#include "../BDL-V3.hpp"
+#include <cstdio>
+#include <new>
+
+namespace {
+
+std::atomic<unsigned long long> allocations = 0;
+
+struct options {
+    unsigned messages = 100000;
+    std::string sink = "/dev/null";
+};
+
+struct mode {
+    const char* name;
+    bool lockFree;
+    bool autoOutput;
+};
+
+const mode modes[] = {
+    { "mutex", false, false },
+    { "lock-free", true, false },
+    { "mutex+auto", false, true },
+    { "lock-free+auto", true, true },
+};
+
+void logBatch(BDL::loggerConstructor& logger, unsigned first, unsigned count) {
+    std::string_view name = "cache";
+    for (unsigned i = first; i < first + count; ++i) {
+        logger.logMessage("request ", i, " took ", i * 0.25, " us in ", name);
+        logger.logf("request {} from {} at {}", i, name, static_cast<const void*>(&logger));
+        BDL_WARN(logger, "retry ", i % 7, " of ", 7);
+    }
+}
+
+// Logs the same kind of messages twice and returns the allocations of the second round
+unsigned long long steadyAllocations(const options& opts, const mode& m) {
+    BDL::loggerConstructor logger;
+    logger.setLogLevel("INFO");
+    logger.setConsoleOutput(false);
+    logger.setFileOutput(true);
+    logger.setFilePath(opts.sink);
+    logger.setLockFree(m.lockFree);
+    logger.setAutoOutput(m.autoOutput);
+    logger.initialize();
+    for (int round = 0; round < 2; ++round) { // Grows the buffers to their working size
+        logBatch(logger, 0, opts.messages);
+        logger.logOutput();
+    }
+    unsigned long long before = allocations.load();
+    logBatch(logger, 0, opts.messages); // Same lines, so the same buffer size as the warm-up
+    logger.logOutput();
+    return allocations.load() - before;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+// Not inlined, so the compiler does not pair the malloc'd pointer with a plain delete
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char** argv) {
+    options opts;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        if (name == "--messages") {
+            opts.messages = static_cast<unsigned>(std::max(1, std::atoi(argv[i + 1])));
+        }
+        else if (name == "--sink") {
+            opts.sink = argv[i + 1];
+        }
+        else {
+            std::cerr << "Error: Unknown option " << name << ".\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool ok = true;
+    for (const mode& m : modes) {
+        unsigned long long count = steadyAllocations(opts, m);
+        std::printf("%-15s allocations after warm-up: %llu %s\n", m.name, count, count ? "FAILED" : "ok");
+        ok = ok && !count;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,218 @@
+// bdl-bench: throughput and per-call latency benchmarks for BDL-V3, results as JSON on stdout.
+// Build: g++ -std=c++17 -O2 -pthread -DBDL_MIN_LEVEL=BDL_LEVEL_INFO tools/bdl-bench.cpp -o bdl-bench
+// Usage: bdl-bench [--threads N] [--messages M] [--sizes 16,128,512] [--sink PATH]
+//   --threads   highest producer thread count, runs 1, 2, 4 ... N (default: hardware threads)
+//   --messages  messages per thread per run (default 100000)
+//   --sizes     message sizes in bytes (default 16,128,512)
+//   --sink      file the logger writes to (default /dev/null), e.g. --sink /dev/shm/bdl-bench.log
+#include "../BDL-V3.hpp"
+#include <algorithm>
+
+namespace {
+
+struct options {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned messages = 100000;
+    std::vector<size_t> sizes = { 16, 128, 512 };
+    std::string sink = "/dev/null";
+};
+
+struct runConfig {
+    unsigned threads;
+    size_t messageSize;
+    bool loopCheck;
+    bool autoOutput;
+    bool lockFree;
+    bool threadBuffers;
+};
+
+struct runResult {
+    double seconds;
+    double flushMillis;
+    unsigned long long p50;
+    unsigned long long p99;
+    unsigned long long p999;
+    unsigned long long max;
+};
+
+volatile unsigned long long sink = 0;
+
+// Stands in for the message building a caller would do, never reached when the statement is disabled
+std::string expensiveMessage(unsigned long long i) {
+    sink = sink + i;
+    return "value " + std::to_string(i);
+}
+
+template <class Body>
+double nanosPerIteration(unsigned long long iterations, Body&& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long i = 0; i < iterations; ++i) {
+        body(i);
+        std::atomic_signal_fence(std::memory_order_seq_cst); // Keeps the loop from being folded away
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+unsigned long long percentile(const std::vector<unsigned>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1));
+    return sorted[index];
+}
+
+runResult runOnce(const options& opts, const runConfig& config) {
+    BDL::loggerConstructor logger;
+    logger.setLogLevel("INFO");
+    logger.setConsoleOutput(false);
+    logger.setFileOutput(true);
+    logger.setFilePath(opts.sink);
+    logger.setLoopCheck(config.loopCheck);
+    logger.setAutoOutput(config.autoOutput);
+    logger.setLockFree(config.lockFree);
+    logger.setThreadBuffers(config.threadBuffers);
+    logger.initialize();
+
+    // 64 distinct texts per thread, so the loop check sees both new messages and repeats
+    std::vector<std::vector<std::string>> texts(config.threads);
+    for (unsigned t = 0; t < config.threads; ++t) {
+        for (unsigned i = 0; i < 64; ++i) {
+            std::string text = "thread " + std::to_string(t) + " message " + std::to_string(i) + ' ';
+            text.resize(std::max(config.messageSize, text.size()), 'x');
+            texts[t].push_back(text);
+        }
+    }
+    std::vector<std::vector<unsigned>> latencies(config.threads, std::vector<unsigned>(opts.messages));
+    std::atomic<unsigned> ready = 0;
+    std::atomic<bool> go = false;
+    std::vector<std::thread> producers;
+    for (unsigned t = 0; t < config.threads; ++t) {
+        producers.emplace_back([&, t] {
+            ++ready;
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (unsigned i = 0; i < opts.messages; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                logger.logMessage(texts[t][i % 64]);
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                latencies[t][i] = static_cast<unsigned>(std::min<long long>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), 0xFFFFFFFFLL));
+            }
+        });
+    }
+    while (ready.load() != config.threads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    auto produced = std::chrono::steady_clock::now();
+    logger.logOutput();
+    auto flushed = std::chrono::steady_clock::now();
+
+    std::vector<unsigned> all;
+    all.reserve(static_cast<size_t>(config.threads) * opts.messages);
+    for (const std::vector<unsigned>& perThread : latencies) {
+        all.insert(all.end(), perThread.begin(), perThread.end());
+    }
+    std::sort(all.begin(), all.end());
+    runResult result;
+    result.seconds = std::chrono::duration<double>(produced - start).count();
+    result.flushMillis = std::chrono::duration<double, std::milli>(flushed - produced).count();
+    result.p50 = percentile(all, 0.50);
+    result.p99 = percentile(all, 0.99);
+    result.p999 = percentile(all, 0.999);
+    result.max = all.empty() ? 0 : all.back();
+    return result;
+}
+
+std::vector<size_t> parseSizes(const std::string& list) {
+    std::vector<size_t> sizes;
+    std::stringstream stream(list);
+    for (std::string item; std::getline(stream, item, ',');) {
+        if (!item.empty()) {
+            sizes.push_back(static_cast<size_t>(std::stoul(item)));
+        }
+    }
+    return sizes;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    options opts;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        if (name == "--threads") {
+            opts.threads = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (name == "--messages") {
+            opts.messages = static_cast<unsigned>(std::max(1, std::atoi(argv[i + 1])));
+        }
+        else if (name == "--sizes") {
+            opts.sizes = parseSizes(argv[i + 1]);
+        }
+        else if (name == "--sink") {
+            opts.sink = argv[i + 1];
+        }
+        else {
+            std::cerr << "Error: Unknown option " << name << ".\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "{\n  \"sink\": \"" << opts.sink << "\",\n  \"messages_per_thread\": " << opts.messages << ",\n  \"runs\": [";
+    std::vector<unsigned> threadCounts;
+    for (unsigned threads = 1; threads < opts.threads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(opts.threads);
+    bool first = true;
+    for (unsigned threads : threadCounts) {
+        for (size_t size : opts.sizes) {
+            // Producer path: mutex, lock-free ring or per-thread buffers
+            for (int mode = 0; mode < 12; ++mode) {
+                runConfig config{ threads, size, (mode & 1) != 0, (mode & 2) != 0, (mode & 12) == 4, (mode & 12) == 8 };
+                runResult result = runOnce(opts, config);
+                double total = static_cast<double>(threads) * opts.messages;
+                std::cout << (first ? "\n" : ",\n") << "    { \"threads\": " << threads
+                          << ", \"message_size\": " << size
+                          << ", \"loop_check\": " << (config.loopCheck ? "true" : "false")
+                          << ", \"auto_output\": " << (config.autoOutput ? "true" : "false")
+                          << ", \"lock_free\": " << (config.lockFree ? "true" : "false")
+                          << ", \"thread_buffers\": " << (config.threadBuffers ? "true" : "false")
+                          << ", \"seconds\": " << result.seconds
+                          << ", \"messages_per_second\": " << static_cast<unsigned long long>(total / result.seconds)
+                          << ", \"final_flush_ms\": " << result.flushMillis
+                          << ", \"latency_ns\": { \"p50\": " << result.p50 << ", \"p99\": " << result.p99
+                          << ", \"p99.9\": " << result.p999 << ", \"max\": " << result.max << " } }";
+                first = false;
+            }
+        }
+    }
+    std::cout << "\n  ],\n";
+
+    // A statement below the compile time or runtime threshold should cost about as much as an empty loop body
+    const unsigned long long iterations = 100000000ULL;
+    BDL::loggerConstructor logger;
+    logger.setLogLevel("INFO");
+    logger.setFileOutput(false);
+    logger.setConsoleOutput(false);
+    logger.setMinLevel(BDL::severity::warn);
+    logger.initialize();
+    double empty = nanosPerIteration(iterations, [](unsigned long long) {});
+    double compiledOut = nanosPerIteration(iterations, [&](unsigned long long i [[maybe_unused]]) {
+        BDL_DEBUG(logger, expensiveMessage(i)); // Below BDL_MIN_LEVEL when built as documented above
+    });
+    double runtimeOff = nanosPerIteration(iterations, [&](unsigned long long i) {
+        BDL_INFO(logger, expensiveMessage(i)); // Below the runtime threshold
+    });
+    std::cout << "  \"disabled_statement_ns\": { \"empty_loop\": " << empty
+              << ", \"below_min_level\": " << compiledOut
+              << ", \"below_runtime_threshold\": " << runtimeOff << " }\n}\n";
+    return 0;
+}
@@ -0,0 +1,81 @@
+// bdl-decode-test: feeds decodeBinaryLog() a valid structured record and damaged copies of it
+// (truncated, lengths and counts pointing past the record, unknown type codes) and checks that
+// every damaged one is rejected as corrupt. Meant to run under ASan, which also catches reads
+// past the record that happen to produce output.
+// Build: g++ -std=c++17 -O1 -g -pthread -fsanitize=address,undefined tools/bdl-decode-test.cpp -o bdl-decode-test
+// Usage: bdl-decode-test
+#include "../BDL-V3.hpp"
+#include <cstdio>
+#include <sstream>
+
+namespace {
+
+struct damage {
+    const char* name;
+    size_t offset; // Byte of the record to overwrite, or the new size for truncations
+    std::string bytes; // Empty for a truncation
+};
+
+// One record with a message and one field of every type
+std::string validRecord() {
+    std::string_view message = "request done";
+    std::string_view path = "/index.html";
+    long long latency = -42;
+    unsigned long long bytes = 512;
+    double ratio = 0.5;
+    bool cached = true;
+    char kind = 'G';
+    const void* address = &message;
+    size_t length = BDL::structuredRecordSize(message, BDL::kv("path", path), BDL::kv("lat", latency), BDL::kv("bytes", bytes),
+                                              BDL::kv("ratio", ratio), BDL::kv("cached", cached), BDL::kv("kind", kind),
+                                              BDL::kv("at", address));
+    std::string record(length, '\0');
+    BDL::encodeStructuredRecord(&record[0], length, 1760000000000000000ULL, BDL::severity::info, 7, message, BDL::kv("path", path),
+                                BDL::kv("lat", latency), BDL::kv("bytes", bytes), BDL::kv("ratio", ratio), BDL::kv("cached", cached),
+                                BDL::kv("kind", kind), BDL::kv("at", address));
+    return record;
+}
+
+std::string bytesOf(unsigned short value) {
+    return std::string(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool decodes(const std::string& log) {
+    std::istringstream in(log);
+    std::ostringstream out;
+    return BDL::decodeBinaryLog(in, out);
+}
+
+} // namespace
+
+int main() {
+    std::string record = validRecord();
+    size_t fields = BDL_STRUCTURED_HEADER + 12; // Field count byte after "request done"
+    const damage cases[] = {
+        { "truncated header", 10, "" },
+        { "truncated message", BDL_STRUCTURED_HEADER + 4, "" },
+        { "truncated field", record.size() - 3, "" },
+        { "message length 0xFFFF", 22, bytesOf(0xFFFF) },
+        { "message past fields", 22, bytesOf(static_cast<unsigned short>(record.size())) },
+        { "field count 200", fields, std::string(1, static_cast<char>(200)) },
+        { "key length 255", fields + 1, std::string(1, static_cast<char>(255)) },
+        { "string length 0xFFFF", fields + 1 + 1 + 4 + 1, bytesOf(0xFFFF) },
+        { "unknown type code", fields + 1 + 1 + 4, "x" },
+    };
+
+    bool ok = decodes(record);
+    std::printf("%-22s %s\n", "valid record", ok ? "ok" : "FAILED");
+    for (const damage& d : cases) {
+        std::string damaged = record;
+        if (d.bytes.empty()) {
+            damaged.resize(d.offset);
+        }
+        else {
+            damaged.replace(d.offset, d.bytes.size(), d.bytes);
+        }
+        bool rejected = !decodes(damaged);
+        std::printf("%-22s %s\n", d.name, rejected ? "ok" : "FAILED");
+        ok = ok && rejected;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
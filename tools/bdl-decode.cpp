@@ -0,0 +1,34 @@
+// bdl-decode: turns a BDL binary log (BDL_LOG_BINARY records, or the output of a
+// structuredFormat::binary sink) back into text.
+// Build: g++ -std=c++17 -O2 -pthread tools/bdl-decode.cpp -o bdl-decode
+// Usage: bdl-decode <binary log> [output file]
+#include "../BDL-V3.hpp"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <binary log> [output file]\n";
+        return EXIT_FAILURE;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Error: Could not open " << argv[1] << ".\n";
+        return EXIT_FAILURE;
+    }
+    if (argc > 2) {
+        std::ofstream out(argv[2]);
+        if (!out) {
+            std::cerr << "Error: Could not open " << argv[2] << " for writing.\n";
+            return EXIT_FAILURE;
+        }
+        if (!BDL::decodeBinaryLog(in, out)) {
+            return EXIT_FAILURE;
+        }
+        out.close();
+        if (!out) {
+            std::cerr << "Error: Could not write " << argv[2] << ".\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    return BDL::decodeBinaryLog(in, std::cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,225 @@
+// bdl-query: prints the records of an indexed log file (BDL::indexedFileSink) that match a query.
+// The file is mapped, and blocks whose footer rules them out are skipped without reading them.
+// Build: g++ -std=c++17 -O2 -pthread tools/bdl-query.cpp -o bdl-query
+// Usage: bdl-query <indexed log> [--from TIME] [--to TIME] [--level LEVEL] [--word WORD]... [--stats]
+//   --from, --to  local time "YYYY-MM-DD HH:MM[:SS]", or "HH:MM[:SS]" on the day of the first
+//                 record. --from is inclusive, --to exclusive
+//   --level       lowest level shown, e.g. ERROR for errors and fatals
+//   --word        only records containing this word (letters, digits, '_' and '-'); repeat for all of several
+//   --stats       blocks read and skipped, on stderr
+// Example: bdl-query app.idx --from 10:02 --to 10:03 --level ERROR
+#include "../BDL-V3.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+struct query {
+    std::string from;
+    std::string to;
+    unsigned long long fromNanos = 0;
+    unsigned long long toNanos = ~0ULL;
+    unsigned minLevel = BDL_LEVEL_TRACE;
+    std::vector<std::string> words;
+    bool stats = false;
+};
+
+// 0 if text is not a time in one of the two forms
+unsigned long long parseTime(const std::string& text, unsigned long long dayNanos) {
+    std::tm fields{};
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    if (std::sscanf(text.c_str(), "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) >= 5) {
+        fields.tm_year = year - 1900;
+        fields.tm_mon = month - 1;
+        fields.tm_mday = day;
+    }
+    else if (std::sscanf(text.c_str(), "%d:%d:%d", &hour, &minute, &second) >= 2) {
+        std::time_t seconds = static_cast<std::time_t>(dayNanos / 1000000000ULL);
+        localtime_r(&seconds, &fields);
+    }
+    else {
+        return 0;
+    }
+    fields.tm_hour = hour;
+    fields.tm_min = minute;
+    fields.tm_sec = second;
+    fields.tm_isdst = -1;
+    std::time_t seconds = std::mktime(&fields);
+    return seconds < 0 ? 0 : static_cast<unsigned long long>(seconds) * 1000000000ULL;
+}
+
+bool hasWord(std::string_view text, std::string_view wanted) {
+    bool found = false;
+    BDL::blockIndex::forEachWord(text, [&](std::string_view word) {
+        found = found || word == wanted;
+    });
+    return found;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <indexed log> [--from TIME] [--to TIME] [--level LEVEL] [--word WORD]... [--stats]\n";
+        return EXIT_FAILURE;
+    }
+    query q;
+    for (int i = 2; i < argc; ++i) {
+        std::string name = argv[i];
+        if (name == "--stats") {
+            q.stats = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << name << " needs a value.\n";
+            return EXIT_FAILURE;
+        }
+        std::string value = argv[++i];
+        if (name == "--from") {
+            q.from = value;
+        }
+        else if (name == "--to") {
+            q.to = value;
+        }
+        else if (name == "--level") {
+            q.minLevel = static_cast<unsigned>(BDL::severityFromName(value));
+        }
+        else if (name == "--word") {
+            q.words.push_back(value);
+        }
+        else {
+            std::cerr << "Error: Unknown option " << name << ".\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    int fd = ::open(argv[1], O_RDONLY);
+    struct stat info;
+    if (fd < 0 || ::fstat(fd, &info) != 0) {
+        std::cerr << "Error: Could not open " << argv[1] << ".\n";
+        return EXIT_FAILURE;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    const size_t headerSize = sizeof(BDL_INDEX_MAGIC) - 1 + sizeof(unsigned);
+    if (size < headerSize) {
+        std::cerr << "Error: Not a BDL indexed log.\n";
+        return EXIT_FAILURE;
+    }
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Error: Could not map " << argv[1] << ".\n";
+        return EXIT_FAILURE;
+    }
+    const char* file = static_cast<const char*>(mapped);
+    unsigned bloomBytes = 0;
+    std::memcpy(&bloomBytes, file + sizeof(BDL_INDEX_MAGIC) - 1, sizeof(bloomBytes));
+    if (std::memcmp(file, BDL_INDEX_MAGIC, sizeof(BDL_INDEX_MAGIC) - 1) != 0 || bloomBytes == 0) {
+        std::cerr << "Error: Not a BDL indexed log.\n";
+        return EXIT_FAILURE;
+    }
+    const size_t footerSize = sizeof(BDL::indexBlockFooter) + bloomBytes;
+
+    // Times without a date refer to the day of the first record
+    if (!q.from.empty() || !q.to.empty()) {
+        unsigned long long firstNanos = 0;
+        if (size >= headerSize + sizeof(unsigned) + footerSize) {
+            unsigned length;
+            std::memcpy(&length, file + headerSize, sizeof(length));
+            if (length >= footerSize && headerSize + sizeof(unsigned) + length <= size) {
+                BDL::indexBlockFooter footer;
+                std::memcpy(&footer, file + headerSize + sizeof(unsigned) + length - footerSize, sizeof(footer));
+                firstNanos = footer.minTimestamp;
+            }
+        }
+        if (!q.from.empty() && !(q.fromNanos = parseTime(q.from, firstNanos))) {
+            std::cerr << "Error: Could not parse --from " << q.from << ".\n";
+            return EXIT_FAILURE;
+        }
+        if (!q.to.empty() && !(q.toNanos = parseTime(q.to, firstNanos))) {
+            std::cerr << "Error: Could not parse --to " << q.to << ".\n";
+            return EXIT_FAILURE;
+        }
+    }
+    unsigned wantedLevels = ~0u << q.minLevel;
+
+    size_t blocks = 0;
+    size_t skipped = 0;
+    std::string text;
+    std::string out;
+    for (size_t offset = headerSize; offset + sizeof(unsigned) <= size;) {
+        unsigned length;
+        std::memcpy(&length, file + offset, sizeof(length));
+        const char* records = file + offset + sizeof(length);
+        offset += sizeof(length) + length;
+        if (length < footerSize || offset > size) {
+            break; // A block that was still being written
+        }
+        ++blocks;
+        BDL::indexBlockFooter footer;
+        std::memcpy(&footer, records + length - footerSize, sizeof(footer));
+        const unsigned char* bloom = reinterpret_cast<const unsigned char*>(records + length - bloomBytes);
+        bool possible = footer.maxTimestamp >= q.fromNanos && footer.minTimestamp < q.toNanos && (footer.levels & wantedLevels);
+        for (const std::string& word : q.words) {
+            possible = possible && BDL::blockIndex::mayContain(bloom, bloomBytes, word);
+        }
+        if (!possible) {
+            ++skipped;
+            continue;
+        }
+        const char* recordsEnd = records + length - footerSize;
+        for (const char* record = records; record < recordsEnd;) {
+            BDL::indexRecordHeader header;
+            if (static_cast<size_t>(recordsEnd - record) < sizeof(header)) {
+                std::cerr << "Error: Corrupt indexed log record.\n";
+                return EXIT_FAILURE;
+            }
+            std::memcpy(&header, record, sizeof(header));
+            const char* payload = record + sizeof(header);
+            if (header.length > static_cast<size_t>(recordsEnd - payload)) { // Would run into the footer or past the file
+                std::cerr << "Error: Corrupt indexed log record.\n";
+                return EXIT_FAILURE;
+            }
+            record = payload + header.length;
+            if (header.timestamp < q.fromNanos || header.timestamp >= q.toNanos || static_cast<unsigned>(header.level) < q.minLevel) {
+                continue;
+            }
+            if (header.structured) {
+                if (!BDL::structuredRecordValid(payload, header.length)) {
+                    std::cerr << "Error: Corrupt structured record.\n";
+                    return EXIT_FAILURE;
+                }
+                BDL::structuredView view(payload);
+                char stamp[BDL_TIMESTAMP_MAX];
+                text.clear();
+                text.append(stamp, BDL::timestampCache::local().format(view.timestamp, 9, stamp));
+                text += ' ';
+                text.append(BDL::severityPrefix(view.level));
+                text += ' ';
+                text.append(view.message);
+                BDL::appendStructuredFields(text, view, false);
+            }
+            else {
+                text.assign(payload, header.length);
+            }
+            bool matches = true;
+            for (const std::string& word : q.words) {
+                matches = matches && hasWord(text, word);
+            }
+            if (matches) {
+                out.append(text);
+                out += '\n';
+            }
+        }
+        if (out.size() >= 64 * 1024) {
+            std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+            out.clear();
+        }
+    }
+    std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (q.stats) {
+        std::cerr << "blocks: " << blocks << ", skipped: " << skipped << ", read: " << blocks - skipped << "\n";
+    }
+    ::munmap(mapped, size);
+    return EXIT_SUCCESS;
+}
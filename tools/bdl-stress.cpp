@@ -0,0 +1,191 @@
+// bdl-stress: hammers one logger from many threads while another thread flips setLoopCheck,
+// setAutoOutput and setFileOutput and a third calls logOutput(), then checks that every line
+// arrived exactly once, whole and in order per thread. Exits non-zero on any failure.
+// Build: g++ -std=c++17 -O1 -g -pthread -fsanitize=thread tools/bdl-stress.cpp -o bdl-stress
+//        (or -fsanitize=address,undefined; plain -O2 for a quick run)
+// Usage: bdl-stress [--threads N] [--messages M] [--mode MODE] [--file PATH]
+//   --threads   producer threads (default 8)
+//   --messages  messages per producer (default 20000)
+//   --mode      one buffering mode, default all of them: a '+' separated list of lockfree, tbuf,
+//               async, shared and writer, or mutex for none. lazy skips initialize()
+//   --file      file the logger writes to while file output is on (default /tmp/bdl-stress.log)
+// Example: bdl-stress --mode lockfree+async+lazy
+#include "../BDL-V3.hpp"
+#include <cstdio>
+
+namespace {
+
+struct options {
+    int threads = 8;
+    int messages = 20000;
+    std::string mode;
+    std::string file = "/tmp/bdl-stress.log";
+};
+
+const char* const allModes[] = {
+    "mutex", "lockfree", "tbuf", "async", "lockfree+async", "tbuf+async", "shared", "lockfree+shared",
+    "tbuf+shared", "writer", "shared+writer", "mutex+lazy", "lockfree+lazy", "tbuf+lazy", "async+lazy",
+    "shared+lazy",
+};
+
+const char* const filler = "xxxxxxxxxxxxxxxxxxxxxxxx";
+
+// Gets every line the logger outputs, independent of the toggled console and file output
+struct collectSink : BDL::logSink {
+    std::mutex mtx;
+    std::string text;
+    void write(const char* data, size_t length) override {
+        std::lock_guard<std::mutex> lock(mtx);
+        text.append(data, length);
+    }
+};
+
+bool hasMode(const std::string& mode, const char* name) {
+    return mode.find(name) != std::string::npos;
+}
+
+int payload(int thread, int index) {
+    return (thread * 7919 + index) % 100003;
+}
+
+void hammer(const options& opts, const std::string& mode, const std::shared_ptr<collectSink>& sink) {
+    BDL::loggerConstructor logger;
+    logger.setLogLevel("INFO");
+    logger.setConsoleOutput(false);
+    logger.setFileOutput(true);
+    logger.setFilePath(opts.file);
+    logger.setAutoOutputInterval(64);
+    logger.setLockFree(hasMode(mode, "lockfree"));
+    logger.setThreadBuffers(hasMode(mode, "tbuf"));
+    logger.setAsyncOutput(hasMode(mode, "async"));
+    logger.setSharedBackend(hasMode(mode, "shared"));
+    logger.setAsyncFileWriter(hasMode(mode, "writer"));
+    logger.addSink(sink);
+    if (!hasMode(mode, "lazy")) {
+        logger.initialize();
+    }
+    std::atomic<bool> done = false;
+    std::thread toggler([&] {
+        unsigned state = 1;
+        while (!done) {
+            state = state * 1103515245 + 12345;
+            logger.setLoopCheck(state & 1);
+            logger.setAutoOutput(state & 2);
+            logger.setFileOutput(state & 4);
+            std::this_thread::yield();
+        }
+    });
+    std::thread outputter([&] {
+        while (!done) {
+            logger.logOutput();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+    std::vector<std::thread> producers;
+    for (int t = 0; t < opts.threads; ++t) {
+        producers.emplace_back([&, t] {
+            for (int i = 0; i < opts.messages; ++i) {
+                logger.logMessage("T", t, " S", i, " P", payload(t, i), " ", filler);
+                if (i % 1000 == 0) {
+                    logger.logMessage("repeat"); // Folded by the loop check while it is on
+                }
+            }
+        });
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    done = true;
+    toggler.join();
+    outputter.join();
+    logger.logOutput();
+}
+
+// Checks the collected lines, prints one result line and returns true if nothing went wrong
+bool verify(const options& opts, const std::string& mode, const std::string& text) {
+    std::vector<std::vector<int>> seen(opts.threads, std::vector<int>(opts.messages, 0));
+    std::vector<int> last(opts.threads, -1);
+    size_t lines = 0;
+    int torn = 0;
+    bool ordered = true;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) {
+            ++torn;
+            break;
+        }
+        std::string line = text.substr(pos, end - pos);
+        pos = end + 1;
+        ++lines;
+        int t = 0, i = 0, p = 0;
+        char tail[64];
+        if (std::sscanf(line.c_str(), "[INFO]T%d S%d P%d %63s", &t, &i, &p, tail) == 4) {
+            if (t < 0 || t >= opts.threads || i < 0 || i >= opts.messages || p != payload(t, i) ||
+                std::strcmp(tail, filler) != 0) {
+                ++torn;
+                continue;
+            }
+            ++seen[t][i];
+            ordered = ordered && i > last[t];
+            last[t] = i;
+        }
+        else if (line != "[INFO]repeat" && line.find("Previous message repeated") == std::string::npos &&
+                 line.find("BDL not initialized") == std::string::npos) {
+            ++torn;
+            std::cerr << "Unexpected line: " << line << '\n';
+        }
+    }
+    int lost = 0, duplicated = 0;
+    for (const std::vector<int>& counts : seen) {
+        for (int count : counts) {
+            lost += count == 0;
+            duplicated += count > 1;
+        }
+    }
+    bool ok = !lost && !duplicated && !torn && ordered;
+    std::printf("%-18s lines=%zu lost=%d duplicated=%d torn=%d ordered=%s %s\n", mode.c_str(), lines, lost,
+                duplicated, torn, ordered ? "yes" : "no", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    options opts;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        if (name == "--threads") {
+            opts.threads = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (name == "--messages") {
+            opts.messages = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (name == "--mode") {
+            opts.mode = argv[i + 1];
+        }
+        else if (name == "--file") {
+            opts.file = argv[i + 1];
+        }
+        else {
+            std::cerr << "Error: Unknown option " << name << ".\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<std::string> modes;
+    if (opts.mode.empty()) {
+        modes.assign(std::begin(allModes), std::end(allModes));
+    }
+    else {
+        modes.push_back(opts.mode);
+    }
+    bool ok = true;
+    for (const std::string& mode : modes) {
+        std::shared_ptr<collectSink> sink = std::make_shared<collectSink>();
+        hammer(opts, mode, sink);
+        ok = verify(opts, mode, sink->text) && ok;
+    }
+    std::remove(opts.file.c_str());
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}